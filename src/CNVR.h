@@ -3,41 +3,22 @@
 
 #include "defines.h"
 #include "Region.h"
-#include <string>
-#include <numeric>
-#include <set>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
 
 class CNVR {
 public:
-  std::string chr;
+  int chr;
   int start;
   int end;
   int length;
   int type;
+  int query;
   double pvalue;
   double qvalue;
   std::vector<const Region*> regions;
 
-  CNVR(const std::vector<CNVR> &_regions) {
-    chr = _regions[0].chr;
-    start = _regions[0].start;
-    end = _regions[0].end;
-    type = _regions[0].type;
-    pvalue = _regions[0].pvalue;
-    qvalue = _regions[0].qvalue;
-    
-    for(const CNVR &r : _regions) {
-      start = std::min(start, r.start);
-      end = std::max(end, r.end);
-      pvalue = std::max(pvalue, r.pvalue);
-      qvalue = std::max(qvalue, r.qvalue);
-      for(const Region *re : r.regions) {
-        regions.push_back(re);
-      }
-    }
-    length = end-start+1;
-  }
-  
   CNVR(
     const Region &region,
     int type,
@@ -49,39 +30,82 @@ public:
       end(region.end),
       length(region.length),
       type(type),
+      query(0),
       pvalue(pvalue),
       qvalue(qvalue)
   {
     regions.push_back(&region);
   }
   
+  // Extends this result by a following result of the same type.
+  void extend(const CNVR &r) {
+    start = std::min(start, r.start);
+    end = std::max(end, r.end);
+    pvalue = std::max(pvalue, r.pvalue);
+    qvalue = std::max(qvalue, r.qvalue);
+    regions.insert(regions.end(), r.regions.begin(), r.regions.end());
+    length = end-start+1;
+  }
+
   std::vector<double> get_freq(size_t group, size_t type) const {
     std::vector<double> freq;
     for(const Region *r : regions) {
-      int sum = std::accumulate(r->state[group][type].begin(), r->state[group][type].end(), 0);
-      double f = (double)sum / r->state[group][type].size();
+      double f = (double)r->count(group, type) / r->states->patients(group);
       freq.push_back(f);
     }
     std::sort(freq.begin(), freq.end());
     return(freq);
   }
   
-  std::vector<std::vector<unsigned int>> get_state(size_t group) {
-    size_t npatients = regions[0]->state[group][0].size();
-    std::vector<std::vector<unsigned int>> state;
+  // Smallest and largest within-group frequency of a type over all regions.
+  void get_freq_range(size_t group, size_t type, double &min, double &max) const {
+    min = 1.0;
+    max = 0.0;
+    for(const Region *r : regions) {
+      double f = (double)r->count(group, type) / r->states->patients(group);
+      min = std::min(min, f);
+      max = std::max(max, f);
+    }
+  }
+
+  // Bitmask (1 << type) per patient of the types, including Normal,
+  // observed in any of the regions.
+  std::vector<unsigned int> get_state_mask(size_t group) const {
+    size_t npatients = regions[0]->states->patients(group);
+    size_t nwords = regions[0]->states->group_words(group);
+
+    // regions are rows of one arena in increasing order
+    std::vector<uint64_t> any(4*nwords, 0);
+    StateReader reader(*regions[0]->states);
+    for(const Region *r : regions) {
+      const uint64_t *row = reader.row(r->index);
+      const uint64_t *gain = row + r->states->word(group, Gain);
+      const uint64_t *loss = row + r->states->word(group, Loss);
+      const uint64_t *loh = row + r->states->word(group, LOH);
+      for(size_t w = 0; w < nwords; ++w) {
+        any[Gain*nwords + w] |= gain[w];
+        any[Loss*nwords + w] |= loss[w];
+        any[LOH*nwords + w] |= loh[w];
+        any[Normal*nwords + w] |= ~(gain[w] | loss[w] | loh[w]);
+      }
+    }
+
+    std::vector<unsigned int> mask(npatients, 0);
     for(size_t i = 0; i < npatients; ++i) {
-      std::set<unsigned int> found;
-      for(const Region *r : regions) {
-        bool is_normal = true;
-        for(size_t type = 0; type < 3; ++type) {
-          if(r->state[group][type][i]) {
-            found.insert(type);
-            is_normal = false;
-          }
-        }
-        if(is_normal) found.insert(Normal);
+      for(size_t type = 0; type < 4; ++type) {
+        if((any[type*nwords + i / 64] >> (i % 64)) & 1) mask[i] |= 1 << type;
+      }
+    }
+    return mask;
+  }
+
+  std::vector<std::vector<unsigned int>> get_state(size_t group) const {
+    std::vector<unsigned int> mask = get_state_mask(group);
+    std::vector<std::vector<unsigned int>> state(mask.size());
+    for(size_t i = 0; i < mask.size(); ++i) {
+      for(size_t type = 0; type < 4; ++type) {
+        if(mask[i] & (1 << type)) state[i].push_back(type);
       }
-      state.emplace_back(found.begin(), found.end());
     }
     return state;
   }
@@ -0,0 +1,61 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include "ChromosomeIndex.h"
+
+int ChromosomeIndex::insert(const std::string &name) {
+  auto it = ids.find(name);
+  if(it != ids.end()) return it->second;
+  int id = names.size();
+  ids.emplace(name, id);
+  names.push_back(name);
+  return id;
+}
+
+std::vector<int> ChromosomeIndex::sort() {
+  std::vector<int> order(names.size());
+  for(size_t i = 0; i < order.size(); ++i) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    return natural_less(names[a], names[b]);
+  });
+
+  std::vector<int> remap(names.size());
+  std::vector<std::string> sorted;
+  for(size_t i = 0; i < order.size(); ++i) {
+    remap[order[i]] = i;
+    sorted.push_back(names[order[i]]);
+    ids[sorted.back()] = i;
+  }
+  names.swap(sorted);
+  return remap;
+}
+
+bool natural_less(const std::string &a, const std::string &b) {
+  size_t i = 0, j = 0;
+  while(i < a.size() && j < b.size()) {
+    bool da = std::isdigit((unsigned char)a[i]);
+    bool db = std::isdigit((unsigned char)b[j]);
+    if(da && db) {
+      // compare numbers by value: skip leading zeros, then length, then digits
+      while(i < a.size() && a[i] == '0') ++i;
+      while(j < b.size() && b[j] == '0') ++j;
+      size_t ei = i, ej = j;
+      while(ei < a.size() && std::isdigit((unsigned char)a[ei])) ++ei;
+      while(ej < b.size() && std::isdigit((unsigned char)b[ej])) ++ej;
+      if(ei-i != ej-j) return ei-i < ej-j;
+      int c = a.compare(i, ei-i, b, j, ej-j);
+      if(c != 0) return c < 0;
+      i = ei;
+      j = ej;
+    } else if(da != db) {
+      return da;
+    } else {
+      if(a[i] != b[j]) return a[i] < b[j];
+      ++i;
+      ++j;
+    }
+  }
+  if(a.size()-i != b.size()-j) return a.size()-i < b.size()-j;
+  return a < b;
+}
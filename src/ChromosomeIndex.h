@@ -0,0 +1,31 @@
+#ifndef CHROMOSOME_INDEX_H
+#define CHROMOSOME_INDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Maps chromosome names to small integer ids used by all internal
+// structures. After sort(), ids follow natural chromosome order
+// (1, 2, ..., 10, ..., X, Y).
+class ChromosomeIndex {
+public:
+  // Returns the id of name, adding it if not seen before.
+  int insert(const std::string &name);
+
+  // Renumbers chromosomes in natural order. Returns the new id of each old id.
+  std::vector<int> sort();
+
+  int id(const std::string &name) const { return ids.at(name); }
+  const std::string &name(int id) const { return names[id]; }
+  size_t size() const { return names.size(); }
+
+private:
+  std::vector<std::string> names;
+  std::unordered_map<std::string, int> ids;
+};
+
+// Compares chromosome names treating runs of digits as numbers.
+bool natural_less(const std::string &a, const std::string &b);
+
+#endif
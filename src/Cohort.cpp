@@ -0,0 +1,518 @@
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include "Cohort.h"
+
+// Index file layout. All integers are stored in native byte order, which
+// is recorded in the header. Sections start at 8 byte aligned offsets.
+namespace {
+  const char MAGIC[8] = {'C', 'O', 'N', 'V', 'A', 'Q', 'I', 'X'};
+  const uint32_t VERSION = 2;
+  const uint32_t ENDIAN_MARK = 0x01020304;
+
+  enum Section {
+    NAME_OFFSETS,   // uint64 per name + 1: chromosomes, then labels of group 1 and 2
+    NAMES,          // concatenated names
+    CHR_REGIONS,    // uint64 per chromosome + 1: first region of each chromosome
+    CHR_POSITIONS,  // uint64 per chromosome + 1: first breakpoint of each chromosome
+    CHR_FLIPS,      // uint64 per chromosome + 1: first flip of each chromosome
+    STARTS,         // int32 per region
+    ENDS,           // int32 per region
+    LENGTHS,        // int32 per region
+    COUNTS,         // 2 x 4 int32 per region
+    STATE_CHECKPOINTS, // packed state row per checkpoint, see StateArena
+    STATE_OFFSETS,  // uint64 per region + 1: first state flip of each region
+    STATE_FLIPS,    // uint32 per state flip: bit flipped since the previous region
+    POSITIONS,      // int32 per breakpoint
+    POSITION_FLIPS, // uint64 per breakpoint: first flip at the breakpoint
+    FLIPS,          // patient, type and delta as int32 per flip
+    NSECTIONS
+  };
+
+  class IndexHeader {
+  public:
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t checksum;
+    uint64_t size;
+    int32_t npatients[2];
+    uint64_t nlabels[2];
+    uint64_t nchromosomes;
+    uint64_t name_bytes;
+    uint64_t nregions;
+    uint64_t row_words;
+    uint64_t state_interval;
+    uint64_t nstate_flips;
+    uint64_t npositions;
+    uint64_t nflips;
+    uint64_t sections[NSECTIONS];
+  };
+
+  static_assert(sizeof(IndexHeader) % 8 == 0, "index header must be 8 byte aligned");
+  static_assert(sizeof(Counts) == 8*sizeof(int32_t), "counts must be packed");
+
+  uint64_t mul(uint64_t a, uint64_t b) {
+    if(a != 0 && b > UINT64_MAX / a) throw std::runtime_error("Invalid index file: corrupt header.");
+    return a*b;
+  }
+
+  uint64_t align(uint64_t x) {
+    return (x + 7) / 8 * 8;
+  }
+
+  // Computes section offsets from the counts in the header.
+  // Returns the total size of the index.
+  uint64_t layout(IndexHeader &h) {
+    uint64_t nnames = h.nchromosomes + h.nlabels[0] + h.nlabels[1];
+    uint64_t bytes[NSECTIONS];
+    bytes[NAME_OFFSETS] = mul(nnames + 1, 8);
+    bytes[NAMES] = h.name_bytes;
+    bytes[CHR_REGIONS] = mul(h.nchromosomes + 1, 8);
+    bytes[CHR_POSITIONS] = mul(h.nchromosomes + 1, 8);
+    bytes[CHR_FLIPS] = mul(h.nchromosomes + 1, 8);
+    bytes[STARTS] = mul(h.nregions, 4);
+    bytes[ENDS] = mul(h.nregions, 4);
+    bytes[LENGTHS] = mul(h.nregions, 4);
+    bytes[COUNTS] = mul(h.nregions, sizeof(Counts));
+    uint64_t ncheckpoints = h.nregions / StateArena::CHECKPOINT_INTERVAL + (h.nregions % StateArena::CHECKPOINT_INTERVAL != 0);
+    bytes[STATE_CHECKPOINTS] = mul(mul(ncheckpoints, h.row_words), 8);
+    bytes[STATE_OFFSETS] = mul(h.nregions + 1, 8);
+    bytes[STATE_FLIPS] = mul(h.nstate_flips, 4);
+    bytes[POSITIONS] = mul(h.npositions, 4);
+    bytes[POSITION_FLIPS] = mul(h.npositions, 8);
+    bytes[FLIPS] = mul(h.nflips, 12);
+
+    uint64_t offset = sizeof(IndexHeader);
+    for(size_t i = 0; i < NSECTIONS; ++i) {
+      h.sections[i] = offset;
+      if(align(bytes[i]) > UINT64_MAX - offset) throw std::runtime_error("Invalid index file: corrupt header.");
+      offset += align(bytes[i]);
+    }
+    return offset;
+  }
+
+  uint64_t checksum(const char *data, size_t size) {
+    uint64_t h = 14695981039346656037ULL;
+    for(size_t i = sizeof(IndexHeader); i < size; i += 8) {
+      uint64_t w;
+      memcpy(&w, data + i, 8);
+      h = (h ^ w) * 1099511628211ULL;
+    }
+    return h;
+  }
+
+  template<typename T>
+  T *section(char *data, const IndexHeader &h, Section s) {
+    return (T*)(data + h.sections[s]);
+  }
+
+  template<typename T>
+  const T *section(const char *data, const IndexHeader &h, Section s) {
+    return (const T*)(data + h.sections[s]);
+  }
+}
+
+Cohort::Cohort(
+  const std::vector<ChromosomeSegments> &chromosomes,
+  const ChromosomeIndex &chromosome_index,
+  int npatients1,
+  int npatients2,
+  const std::vector<std::string> &labels1,
+  const std::vector<std::string> &labels2,
+  ThreadPool &pool
+) : engine_bytes(0) {
+  std::vector<StateArena> arenas;
+  std::vector<Region> regions;
+  get_regions(chromosomes, npatients1, npatients2, pool, arenas, regions);
+
+  // the engine is only used for its flips here and is rebuilt from the
+  // image if q-values are computed, so flips are not kept twice
+  std::unique_ptr<PermutationEngine> permutations(new PermutationEngine(chromosomes, npatients1, npatients2, false));
+  const std::vector<ChromosomeFlips> &chr_flips = permutations->flips();
+
+  std::vector<std::string> names;
+  for(size_t i = 0; i < chromosome_index.size(); ++i) names.push_back(chromosome_index.name(i));
+  names.insert(names.end(), labels1.begin(), labels1.end());
+  names.insert(names.end(), labels2.begin(), labels2.end());
+
+  IndexHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.byte_order = ENDIAN_MARK;
+  h.npatients[0] = npatients1;
+  h.npatients[1] = npatients2;
+  h.nlabels[0] = labels1.size();
+  h.nlabels[1] = labels2.size();
+  h.nchromosomes = chromosome_index.size();
+  for(const std::string &name : names) h.name_bytes += name.size();
+  h.nregions = regions.size();
+
+  // delta encoded states of all chromosomes in region order
+  StateArena states_all(npatients1, npatients2);
+  for(const StateArena &a : arenas) states_all.append(a);
+  arenas.clear();
+  h.row_words = states_all.row_size();
+  h.state_interval = StateArena::CHECKPOINT_INTERVAL;
+  h.nstate_flips = states_all.nflips();
+  for(const ChromosomeFlips &c : chr_flips) {
+    h.npositions += c.positions.size();
+    h.nflips += c.flips.size();
+  }
+  h.size = layout(h);
+
+  image.resize(h.size / 8, 0);
+  char *out = (char*)image.data();
+
+  uint64_t *name_offsets = section<uint64_t>(out, h, NAME_OFFSETS);
+  char *name_chars = section<char>(out, h, NAMES);
+  name_offsets[0] = 0;
+  for(size_t i = 0; i < names.size(); ++i) {
+    memcpy(name_chars + name_offsets[i], names[i].data(), names[i].size());
+    name_offsets[i+1] = name_offsets[i] + names[i].size();
+  }
+
+  // regions are ordered by chromosome id
+  uint64_t *out_chr_regions = section<uint64_t>(out, h, CHR_REGIONS);
+  for(const Region &r : regions) ++out_chr_regions[r.chr+1];
+  for(size_t c = 0; c < h.nchromosomes; ++c) out_chr_regions[c+1] += out_chr_regions[c];
+
+  int32_t *out_starts = section<int32_t>(out, h, STARTS);
+  int32_t *out_ends = section<int32_t>(out, h, ENDS);
+  int32_t *out_lengths = section<int32_t>(out, h, LENGTHS);
+  Counts *out_counts = section<Counts>(out, h, COUNTS);
+  size_t nchunks = std::min<size_t>(regions.size(), 4*pool.size());
+  pool.parallel_for(nchunks, [&](size_t k) {
+    for(size_t i = k * regions.size() / nchunks; i < (k+1) * regions.size() / nchunks; ++i) {
+      const Region &r = regions[i];
+      out_starts[i] = r.start;
+      out_ends[i] = r.end;
+      out_lengths[i] = r.length;
+      out_counts[i] = r.counts;
+    }
+  });
+  regions.clear();
+
+  if(h.nregions > 0) {
+    memcpy(section<uint64_t>(out, h, STATE_CHECKPOINTS), states_all.checkpoint(0), states_all.checkpoints()*h.row_words*8);
+  }
+  memcpy(section<uint64_t>(out, h, STATE_OFFSETS), states_all.flip_offsets(), (h.nregions+1)*8);
+  memcpy(section<uint32_t>(out, h, STATE_FLIPS), states_all.flips(), h.nstate_flips*4);
+  states_all = StateArena(npatients1, npatients2);
+
+  // flips are ordered by chromosome id as well
+  uint64_t *out_chr_positions = section<uint64_t>(out, h, CHR_POSITIONS);
+  uint64_t *out_chr_flips = section<uint64_t>(out, h, CHR_FLIPS);
+  for(const ChromosomeFlips &c : chr_flips) {
+    out_chr_positions[c.chr+1] = c.positions.size();
+    out_chr_flips[c.chr+1] = c.flips.size();
+  }
+  for(size_t c = 0; c < h.nchromosomes; ++c) {
+    out_chr_positions[c+1] += out_chr_positions[c];
+    out_chr_flips[c+1] += out_chr_flips[c];
+  }
+
+  int32_t *out_positions = section<int32_t>(out, h, POSITIONS);
+  uint64_t *out_position_flips = section<uint64_t>(out, h, POSITION_FLIPS);
+  int32_t *out_flips = section<int32_t>(out, h, FLIPS);
+  for(const ChromosomeFlips &c : chr_flips) {
+    uint64_t p = out_chr_positions[c.chr];
+    uint64_t f = out_chr_flips[c.chr];
+    for(size_t i = 0; i < c.positions.size(); ++i) {
+      out_positions[p+i] = c.positions[i];
+      out_position_flips[p+i] = f + c.offsets[i];
+    }
+    for(size_t i = 0; i < c.flips.size(); ++i) {
+      out_flips[3*(f+i)] = c.flips[i].patient;
+      out_flips[3*(f+i)+1] = c.flips[i].type;
+      out_flips[3*(f+i)+2] = c.flips[i].delta;
+    }
+  }
+
+  permutations.reset();
+
+  h.checksum = checksum(out, h.size);
+  memcpy(out, &h, sizeof(h));
+
+  data = out;
+  data_size = h.size;
+  open(false);
+}
+
+Cohort::Cohort(const std::string &path, bool verify)
+  : file(new MappedFile(path)),
+    engine_bytes(0)
+{
+  data = file->data();
+  data_size = file->size();
+  open(verify);
+}
+
+void Cohort::open(bool verify) {
+  IndexHeader h;
+  if(data_size < sizeof(h)) throw std::runtime_error("Invalid index file: file is too small.");
+  memcpy(&h, data, sizeof(h));
+
+  if(memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) throw std::runtime_error("Invalid index file: not a convaq index.");
+  if(h.byte_order != ENDIAN_MARK) throw std::runtime_error("Invalid index file: written on a machine with different byte order.");
+  if(h.version != VERSION) {
+    throw std::runtime_error("Unsupported index version " + std::to_string(h.version) + ", expected " + std::to_string(VERSION) + ".");
+  }
+
+  IndexHeader expected = h;
+  if(h.npatients[0] < 0 || h.npatients[1] < 0 || h.size != data_size || layout(expected) != h.size ||
+     memcmp(expected.sections, h.sections, sizeof(h.sections)) != 0 ||
+     h.row_words != StateArena(h.npatients[0], h.npatients[1]).row_size() ||
+     h.state_interval != StateArena::CHECKPOINT_INTERVAL) {
+    throw std::runtime_error("Invalid index file: corrupt header.");
+  }
+  if(verify && checksum(data, data_size) != h.checksum) {
+    throw std::runtime_error("Invalid index file: checksum mismatch.");
+  }
+
+  npatients[0] = h.npatients[0];
+  npatients[1] = h.npatients[1];
+  nregions = h.nregions;
+
+  const uint64_t *name_offsets = section<uint64_t>(data, h, NAME_OFFSETS);
+  const char *name_chars = section<char>(data, h, NAMES);
+  uint64_t nnames = h.nchromosomes + h.nlabels[0] + h.nlabels[1];
+  if(name_offsets[0] != 0 || name_offsets[nnames] != h.name_bytes) throw std::runtime_error("Invalid index file: corrupt names.");
+  for(size_t i = 0; i < nnames; ++i) {
+    if(name_offsets[i] > name_offsets[i+1]) throw std::runtime_error("Invalid index file: corrupt names.");
+  }
+  std::vector<std::string> names;
+  for(size_t i = 0; i < nnames; ++i) {
+    names.emplace_back(name_chars + name_offsets[i], name_offsets[i+1] - name_offsets[i]);
+  }
+  chromosome_index = ChromosomeIndex();
+  for(size_t i = 0; i < h.nchromosomes; ++i) chromosome_index.insert(names[i]);
+  patient_labels[0].assign(names.begin() + h.nchromosomes, names.begin() + h.nchromosomes + h.nlabels[0]);
+  patient_labels[1].assign(names.begin() + h.nchromosomes + h.nlabels[0], names.end());
+
+  // everything used as an index is checked up front, as the checksum is
+  // only verified on request
+  chr_regions = section<uint64_t>(data, h, CHR_REGIONS);
+  chr_positions = section<uint64_t>(data, h, CHR_POSITIONS);
+  chr_flips = section<uint64_t>(data, h, CHR_FLIPS);
+  if(chr_regions[0] != 0 || chr_positions[0] != 0 || chr_flips[0] != 0 ||
+     chr_regions[h.nchromosomes] != h.nregions || chr_positions[h.nchromosomes] != h.npositions ||
+     chr_flips[h.nchromosomes] != h.nflips) {
+    throw std::runtime_error("Invalid index file: corrupt chromosome table.");
+  }
+  for(size_t c = 0; c < h.nchromosomes; ++c) {
+    if(chr_regions[c] > chr_regions[c+1] || chr_positions[c] > chr_positions[c+1] || chr_flips[c] > chr_flips[c+1]) {
+      throw std::runtime_error("Invalid index file: corrupt chromosome table.");
+    }
+  }
+
+  starts = section<int32_t>(data, h, STARTS);
+  ends = section<int32_t>(data, h, ENDS);
+  lengths = section<int32_t>(data, h, LENGTHS);
+  counts = section<Counts>(data, h, COUNTS);
+  positions = section<int32_t>(data, h, POSITIONS);
+  position_flips = section<uint64_t>(data, h, POSITION_FLIPS);
+  flips = section<int32_t>(data, h, FLIPS);
+
+  // counts index the p-value table and hit bounds
+  for(size_t i = 0; i < h.nregions; ++i) {
+    for(size_t group = 0; group < 2; ++group) {
+      for(int count : counts[i][group]) {
+        if(count < 0 || count > npatients[group]) throw std::runtime_error("Invalid index file: corrupt counts.");
+      }
+    }
+  }
+
+  // flips of each breakpoint lie within the flips of its chromosome, and
+  // flips index the patients and types of the permutation engine
+  for(size_t c = 0; c < h.nchromosomes; ++c) {
+    uint64_t previous = chr_flips[c];
+    for(uint64_t p = chr_positions[c]; p < chr_positions[c+1]; ++p) {
+      if(position_flips[p] < previous || position_flips[p] > chr_flips[c+1]) {
+        throw std::runtime_error("Invalid index file: corrupt breakpoints.");
+      }
+      previous = position_flips[p];
+    }
+  }
+  for(size_t f = 0; f < h.nflips; ++f) {
+    int32_t patient = flips[3*f], type = flips[3*f+1], delta = flips[3*f+2];
+    if(patient < 0 || patient >= npatients[0] + npatients[1] || type < 0 || type > Normal || delta < -1 || delta > 1) {
+      throw std::runtime_error("Invalid index file: corrupt flips.");
+    }
+  }
+
+  // state flips are applied to row buffers, so they are checked up front
+  const uint64_t *state_offsets = section<uint64_t>(data, h, STATE_OFFSETS);
+  const uint32_t *state_flips = section<uint32_t>(data, h, STATE_FLIPS);
+  if(state_offsets[0] != 0 || state_offsets[h.nregions] != h.nstate_flips) {
+    throw std::runtime_error("Invalid index file: corrupt states.");
+  }
+  for(size_t i = 0; i < h.nregions; ++i) {
+    if(state_offsets[i] > state_offsets[i+1]) throw std::runtime_error("Invalid index file: corrupt states.");
+  }
+  states.reset(new StateArena(
+    npatients[0], npatients[1],
+    section<uint64_t>(data, h, STATE_CHECKPOINTS), state_offsets, state_flips,
+    nregions
+  ));
+  // states are returned per patient and counted per bitset, so neither
+  // flips nor checkpoints may touch the padding of a bitset
+  for(size_t i = 0; i < h.nstate_flips; ++i) {
+    if(!states->is_patient(state_flips[i])) throw std::runtime_error("Invalid index file: corrupt states.");
+  }
+  for(size_t k = 0; k < states->checkpoints(); ++k) {
+    if(!states->valid_row(states->checkpoint(k))) throw std::runtime_error("Invalid index file: corrupt states.");
+  }
+}
+
+void Cohort::save(const std::string &path) const {
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  if(!out) throw std::runtime_error("Cannot open file for writing: " + path);
+  out.write(data, data_size);
+  out.close();
+  if(!out) throw std::runtime_error("Cannot write file: " + path);
+}
+
+size_t Cohort::memory_usage() const {
+  size_t bytes = sizeof(Cohort) + image.capacity() * sizeof(uint64_t) + engine_bytes;
+  for(size_t i = 0; i < chromosome_index.size(); ++i) bytes += chromosome_index.name(i).capacity();
+  for(const std::vector<std::string> &labels : patient_labels) {
+    for(const std::string &label : labels) bytes += sizeof(std::string) + label.capacity();
+  }
+  if(states) bytes += sizeof(StateArena);
+  return bytes;
+}
+
+namespace {
+  // Consecutive regions of a chromosome evaluated as a single task, with
+  // its hits and unmerged results.
+  class Chunk {
+  public:
+    size_t chr;
+    size_t begin;
+    size_t end;
+    size_t pruned;
+    std::deque<Region> hits;
+    std::vector<CNVR> results;
+
+    Chunk(size_t chr, size_t begin, size_t end) : chr(chr), begin(begin), end(end), pruned(0) {}
+  };
+}
+
+void Cohort::evaluate(
+  const RegionModel &model,
+  const RegionFilter &filter,
+  const HitBounds *bounds,
+  bool merge,
+  unsigned int merge_threshold,
+  ThreadPool &pool,
+  std::vector<std::deque<Region>> &hits,
+  std::vector<size_t> &npruned,
+  std::vector<CNVR> &results
+) const {
+  size_t nchr = chromosome_index.size();
+
+  hits.clear();
+  hits.resize(nchr);
+  npruned.assign(nchr, 0);
+  std::vector<std::vector<CNVR>> chr_results(nchr);
+
+  // split chromosomes into chunks of whole filter blocks, about four per
+  // worker, so that large chromosomes do not leave workers idle
+  size_t chunk_size = (nregions / (4*pool.size()) + FILTER_BLOCK_SIZE - 1) / FILTER_BLOCK_SIZE * FILTER_BLOCK_SIZE;
+  chunk_size = std::max(chunk_size, EVALUATE_CHUNK_SIZE);
+  std::deque<Chunk> chunks;
+  std::vector<size_t> chr_chunks(nchr+1, 0);
+  for(size_t c = 0; c < nchr; ++c) {
+    for(size_t i = chr_regions[c]; i < chr_regions[c+1]; i += chunk_size) {
+      chunks.emplace_back(c, i, std::min<size_t>(i + chunk_size, chr_regions[c+1]));
+    }
+    chr_chunks[c+1] = chunks.size();
+  }
+
+  pool.parallel_for(chunks.size(), [&](size_t k) {
+    Chunk &chunk = chunks[k];
+    unsigned char keep[FILTER_BLOCK_SIZE];
+    for(size_t i = chunk.begin; i < chunk.end; ++i) {
+      // screen the counts of the following block of regions at once
+      size_t block = (i - chunk.begin) % FILTER_BLOCK_SIZE;
+      if(filter && block == 0) {
+        size_t n = std::min<size_t>(FILTER_BLOCK_SIZE, chunk.end - i);
+        std::fill(keep, keep + n, 1);
+        filter(counts + i, n, keep);
+      }
+      if((filter && !keep[block]) || (bounds && !bounds->possible(counts[i]))) {
+        ++chunk.pruned;
+        continue;
+      }
+
+      Region region(chunk.chr, starts[i], ends[i], lengths[i], counts[i], states.get(), i);
+      size_t first = chunk.results.size();
+      model(region, chunk.results);
+      if(chunk.results.size() == first) continue;
+
+      chunk.hits.push_back(region);
+      for(size_t j = first; j < chunk.results.size(); ++j) {
+        chunk.results[j].regions[0] = &chunk.hits.back();
+      }
+    }
+  });
+  if(pool.cancelled()) return;
+
+  // join the chunks of each chromosome in order, merging adjacent results
+  // as if the chromosome had been evaluated by a single task
+  pool.parallel_for(nchr, [&](size_t c) {
+    AdjacentMerger merger(merge_threshold);
+    for(size_t k = chr_chunks[c]; k < chr_chunks[c+1]; ++k) {
+      Chunk &chunk = chunks[k];
+      npruned[c] += chunk.pruned;
+
+      size_t first = chr_results[c].size();
+      std::move(chunk.results.begin(), chunk.results.end(), std::back_inserter(chr_results[c]));
+      size_t j = first;
+      for(const Region &region : chunk.hits) {
+        hits[c].push_back(region);
+        for(; j < chr_results[c].size() && chr_results[c][j].regions[0] == &region; ++j) {
+          chr_results[c][j].regions[0] = &hits[c].back();
+        }
+      }
+      if(merge) merger.add(chr_results[c], first);
+
+      std::deque<Region>().swap(chunk.hits);
+    }
+  });
+
+  results.clear();
+  for(std::vector<CNVR> &r : chr_results) {
+    std::move(r.begin(), r.end(), std::back_inserter(results));
+  }
+}
+
+const PermutationEngine &Cohort::engine() const {
+  std::call_once(engine_once, [this]() {
+    std::vector<ChromosomeFlips> chromosomes;
+    for(size_t c = 0; c < chromosome_index.size(); ++c) {
+      if(chr_positions[c+1] == chr_positions[c]) continue;
+      chromosomes.emplace_back();
+      ChromosomeFlips &out = chromosomes.back();
+      out.chr = c;
+      for(uint64_t p = chr_positions[c]; p < chr_positions[c+1]; ++p) {
+        out.positions.push_back(positions[p]);
+        out.offsets.push_back(position_flips[p] - chr_flips[c]);
+      }
+      out.offsets.push_back(chr_flips[c+1] - chr_flips[c]);
+      for(uint64_t f = chr_flips[c]; f < chr_flips[c+1]; ++f) {
+        out.flips.emplace_back(flips[3*f], flips[3*f+1], flips[3*f+2]);
+      }
+    }
+    engine_ptr.reset(new PermutationEngine(std::move(chromosomes), npatients[0], npatients[1]));
+    engine_bytes = engine_ptr->memory_usage();
+  });
+  return *engine_ptr;
+}
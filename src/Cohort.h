@@ -0,0 +1,120 @@
+#ifndef COHORT_H
+#define COHORT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "Region.h"
+#include "CNVR.h"
+#include "StateArena.h"
+#include "ChromosomeIndex.h"
+#include "PermutationEngine.h"
+#include "MappedFile.h"
+#include "get_regions.h"
+#include "HitBounds.h"
+#include "ThreadPool.h"
+
+// All regions of two groups of segments with their counts, delta encoded patient
+// states and permutation flips, ready for repeated model evaluation.
+//
+// The data is kept in a single image using the layout of the binary index
+// format, so a cohort can be saved as is and later reopened by mapping the
+// file without sweeping the segments again.
+//
+// A cohort is immutable once constructed, so any number of threads may
+// evaluate models on it concurrently.
+class Cohort {
+public:
+  // Sweeps the segments of both groups. labels are the patient names of
+  // each group and are stored alongside the regions.
+  Cohort(
+    const std::vector<ChromosomeSegments> &chromosomes,
+    const ChromosomeIndex &chromosome_index,
+    int npatients1,
+    int npatients2,
+    const std::vector<std::string> &labels1,
+    const std::vector<std::string> &labels2,
+    ThreadPool &pool
+  );
+
+  // Opens an index written by save(). Throws std::runtime_error if the
+  // file is not a valid index of a supported version, or if verify is set
+  // and the checksum does not match.
+  Cohort(const std::string &path, bool verify);
+
+  Cohort(const Cohort&) = delete;
+  Cohort &operator=(const Cohort&) = delete;
+
+  void save(const std::string &path) const;
+
+  int patients(size_t group) const { return npatients[group]; }
+  const std::vector<std::string> &labels(size_t group) const { return patient_labels[group]; }
+  const ChromosomeIndex &chromosomes() const { return chromosome_index; }
+  size_t size() const { return nregions; }
+  size_t size(size_t chr) const { return chr_regions[chr+1] - chr_regions[chr]; }
+
+  // Bytes allocated on the heap, including the permutation engine once built.
+  size_t memory_usage() const;
+
+  // Bytes mapped from the index file, 0 for cohorts built in memory.
+  size_t mapped_size() const { return file ? data_size : 0; }
+
+  // Evaluates the model on every region, splitting chromosomes into chunks
+  // of consecutive regions evaluated as separate tasks. Results are ordered
+  // by chromosome and position, are the same for any number of threads and
+  // reference regions in hits, which in turn reference the cohort's states. If filter or bounds are
+  // set, the model is only evaluated on regions passing them, and npruned
+  // receives the number of other regions of each chromosome. With merge
+  // set, adjacent results are merged as they are found.
+  void evaluate(
+    const RegionModel &model,
+    const RegionFilter &filter,
+    const HitBounds *bounds,
+    bool merge,
+    unsigned int merge_threshold,
+    ThreadPool &pool,
+    std::vector<std::deque<Region>> &hits,
+    std::vector<size_t> &npruned,
+    std::vector<CNVR> &results
+  ) const;
+
+  // Permutation engine for q-values, built from the stored flips on first use.
+  const PermutationEngine &engine() const;
+
+private:
+  int npatients[2];
+  ChromosomeIndex chromosome_index;
+  std::vector<std::string> patient_labels[2];
+  size_t nregions;
+
+  // image of the index, either owned or mapped from a file
+  std::vector<uint64_t> image;
+  std::unique_ptr<MappedFile> file;
+  const char *data;
+  size_t data_size;
+
+  // views into the image
+  const uint64_t *chr_regions;
+  const uint64_t *chr_positions;
+  const uint64_t *chr_flips;
+  const int32_t *starts;
+  const int32_t *ends;
+  const int32_t *lengths;
+  const Counts *counts;
+  const uint64_t *position_flips;
+  const int32_t *positions;
+  const int32_t *flips;
+  std::unique_ptr<StateArena> states;
+
+  mutable std::once_flag engine_once;
+  mutable std::unique_ptr<PermutationEngine> engine_ptr;
+  mutable std::atomic<size_t> engine_bytes;
+
+  void open(bool verify);
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include <vector>
+#include <algorithm>
+#include "Contrast.h"
+#include "defines.h"
+
+Contrast::Contrast(const std::vector<int> &groups1, const std::vector<int> &groups2, const std::vector<int> &labels) {
+  int ngroups = 0;
+  for(int g : labels) ngroups = std::max(ngroups, g + 1);
+  for(int g : groups1) ngroups = std::max(ngroups, g + 1);
+  for(int g : groups2) ngroups = std::max(ngroups, g + 1);
+
+  group_side.assign(ngroups, -1);
+  for(int g : groups1) group_side[g] = 0;
+  for(int g : groups2) group_side[g] = 1;
+
+  npatients[0] = npatients[1] = 0;
+  side.resize(labels.size());
+  index.resize(labels.size());
+  for(size_t i = 0; i < labels.size(); ++i) {
+    side[i] = group_side[labels[i]];
+    index[i] = side[i] < 0 ? -1 : npatients[side[i]]++;
+  }
+}
+
+Counts Contrast::counts(const GroupCounts &group_counts) const {
+  Counts c = {{ {{0, 0, 0, 0}}, {{0, 0, 0, 0}} }};
+  for(size_t g = 0; g < group_counts.size(); ++g) {
+    if(group_side[g] < 0) continue;
+    for(size_t type = 0; type < 4; ++type) c[group_side[g]][type] += group_counts[g][type];
+  }
+  return c;
+}
+
+void Contrast::convert_row(
+  const StateArena &all, const std::vector<uint64_t> &row,
+  const StateArena &states, std::vector<uint64_t> &out
+) const {
+  out.assign(states.row_size(), 0);
+  size_t nwords = all.group_words(0);
+  for(size_t type = 0; type < 3; ++type) {
+    const uint64_t *w = row.data() + all.word(0, type);
+    for(size_t k = 0; k < nwords; ++k) {
+      // visit set bits only
+      for(uint64_t bits = w[k]; bits != 0; bits &= bits - 1) {
+        size_t p = k*64 + __builtin_ctzll(bits);
+        if(side[p] >= 0) states.set(out, side[p], type, index[p], true);
+      }
+    }
+  }
+}
+
+ContrastSweep::ContrastSweep(const std::vector<Contrast> &contrasts, const std::vector<int> &labels)
+  : contrasts(&contrasts),
+    labels(&labels),
+    marked(contrasts.size(), 0),
+    open(contrasts.size(), 0),
+    start(contrasts.size(), 0),
+    counts(contrasts.size())
+{
+  int ngroups = 0;
+  for(int g : labels) ngroups = std::max(ngroups, g + 1);
+  group_contrasts.resize(ngroups);
+  for(int g = 0; g < ngroups; ++g) {
+    for(size_t c = 0; c < contrasts.size(); ++c) {
+      if(contrasts[c].compares(g)) group_contrasts[g].push_back(c);
+    }
+  }
+}
+
+void ContrastSweep::begin(int position, const GroupCounts &group_counts) {
+  for(size_t c : touched) {
+    open[c] = 1;
+    start[c] = position;
+    counts[c] = (*contrasts)[c].counts(group_counts);
+    marked[c] = 0;
+  }
+  touched.clear();
+}
@@ -0,0 +1,92 @@
+#ifndef CONTRAST_H
+#define CONTRAST_H
+
+#include <vector>
+#include <array>
+#include <cstdint>
+#include "Region.h"
+#include "StateArena.h"
+
+// Per-type counts of each patient group in multi-group mode.
+typedef std::vector<std::array<int, 4>> GroupCounts;
+
+// Comparison of two disjoint sets of patient groups in multi-group mode,
+// e.g. one group against all others. The two sides take the place of the
+// two groups of a two-group analysis. Patients of each side keep their
+// global order.
+class Contrast {
+public:
+  // labels[i] is the group of global patient i.
+  Contrast(const std::vector<int> &groups1, const std::vector<int> &groups2, const std::vector<int> &labels);
+
+  int patients(size_t side) const { return npatients[side]; }
+
+  // True if patients of the group are on either side.
+  bool compares(size_t group) const { return group < group_side.size() && group_side[group] >= 0; }
+
+  // Sums the counts of the groups of each side.
+  Counts counts(const GroupCounts &group_counts) const;
+
+  // Converts a row of all patients, laid out as by a StateArena with all
+  // patients in group 0, to a row of states laid out as by
+  // StateArena(patients(0), patients(1)).
+  void convert_row(
+    const StateArena &all, const std::vector<uint64_t> &row,
+    const StateArena &states, std::vector<uint64_t> &out
+  ) const;
+
+private:
+  int npatients[2];
+  // side of each group, -1 for groups not compared
+  std::vector<int> group_side;
+  // side of each patient, -1 for patients not compared, and index within it
+  std::vector<int> side;
+  std::vector<int> index;
+};
+
+// Tracks the regions of each contrast while sweeping the breakpoints of all
+// patients. A region of a contrast only ends at a breakpoint where patients
+// of its groups have events, so its regions are those of a two-group
+// analysis of its sides.
+class ContrastSweep {
+public:
+  ContrastSweep(const std::vector<Contrast> &contrasts, const std::vector<int> &labels);
+
+  // Marks the contrasts comparing the group of a patient with an event at
+  // the next breakpoint.
+  void touch(int patient) {
+    for(size_t c : group_contrasts[(*labels)[patient]]) {
+      if(!marked[c]) {
+        marked[c] = 1;
+        touched.push_back(c);
+      }
+    }
+  }
+
+  // Ends the open regions of marked contrasts at the breakpoint, calling
+  // end_region(c, start, counts) for each. Called before the events at the
+  // breakpoint are applied.
+  template<typename End>
+  void end(End end_region) const {
+    for(size_t c : touched) {
+      if(open[c]) end_region(c, start[c], counts[c]);
+    }
+  }
+
+  // Opens regions of marked contrasts at position with the counts after
+  // the events, and clears the marks.
+  void begin(int position, const GroupCounts &group_counts);
+
+private:
+  const std::vector<Contrast> *contrasts;
+  const std::vector<int> *labels;
+  // contrasts comparing each group
+  std::vector<std::vector<size_t>> group_contrasts;
+  std::vector<size_t> touched;
+  std::vector<unsigned char> marked;
+  std::vector<unsigned char> open;
+  std::vector<int> start;
+  std::vector<Counts> counts;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// FNV-1a hash identifying the inputs a result was computed from.
+class Fingerprint {
+public:
+  Fingerprint() : h(14695981039346656037ULL) {}
+
+  void add(const void *data, size_t size) {
+    const unsigned char *p = (const unsigned char*)data;
+    for(size_t i = 0; i < size; ++i) h = (h ^ p[i]) * 1099511628211ULL;
+  }
+
+  template<typename T>
+  void add(const T &x) { add(&x, sizeof(x)); }
+
+  template<typename T>
+  void add(const std::vector<T> &v) {
+    add((uint64_t)v.size());
+    if(!v.empty()) add(v.data(), v.size()*sizeof(T));
+  }
+
+  void add(const std::string &s) {
+    add((uint64_t)s.size());
+    add(s.data(), s.size());
+  }
+
+  uint64_t value() const { return h; }
+
+private:
+  uint64_t h;
+};
+
+#endif
@@ -0,0 +1,8 @@
+#include "HitBounds.h"
+
+HitBounds::HitBounds(int npatients1, int npatients2) {
+  for(size_t type = 0; type < 3; ++type) {
+    lows[type].assign(npatients1 + npatients2 + 1, npatients1);
+    highs[type].assign(npatients1 + npatients2 + 1, npatients1 + 1);
+  }
+}
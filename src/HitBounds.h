@@ -0,0 +1,42 @@
+#ifndef HIT_BOUNDS_H
+#define HIT_BOUNDS_H
+
+#include <vector>
+#include <array>
+#include <cstddef>
+#include "Region.h"
+
+// Group 1 counts for which a model may report a result of a type, given
+// the total count of the type over both groups. A result of a type with
+// a total of n patients is only possible if the group 1 count is at most
+// low(type, n) or at least high(type, n). Used to skip evaluating the
+// model on regions that cannot produce results.
+class HitBounds {
+public:
+  // Bounds allowing every count.
+  HitBounds(int npatients1, int npatients2);
+
+  int low(size_t type, int total) const { return lows[type][total]; }
+  int high(size_t type, int total) const { return highs[type][total]; }
+
+  void set(size_t type, int total, int low, int high) {
+    lows[type][total] = low;
+    highs[type][total] = high;
+  }
+
+  // True if the counts may produce a result of any type.
+  bool possible(const Counts &counts) const {
+    for(size_t type = 0; type < 3; ++type) {
+      int pos1 = counts[0][type];
+      int total = pos1 + counts[1][type];
+      if(pos1 <= lows[type][total] || pos1 >= highs[type][total]) return true;
+    }
+    return false;
+  }
+
+private:
+  std::array<std::vector<int>, 3> lows;
+  std::array<std::vector<int>, 3> highs;
+};
+
+#endif
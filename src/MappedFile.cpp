@@ -0,0 +1,58 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &path)
+  : ptr(nullptr),
+    length(0),
+    mapped(false)
+{
+#ifndef _WIN32
+  int fd = open(path.c_str(), O_RDONLY);
+  if(fd < 0) throw std::runtime_error("Cannot open file: " + path);
+
+  struct stat st;
+  if(fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Cannot read file: " + path);
+  }
+  length = st.st_size;
+
+  if(length > 0) {
+    void *p = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(p == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Cannot map file: " + path);
+    }
+    madvise(p, length, MADV_SEQUENTIAL);
+    ptr = (const char*)p;
+    mapped = true;
+  }
+  close(fd);
+#else
+  std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+  if(!in) throw std::runtime_error("Cannot open file: " + path);
+  length = in.tellg();
+  buffer.resize(length);
+  in.seekg(0);
+  if(length > 0 && !in.read(buffer.data(), length)) {
+    throw std::runtime_error("Cannot read file: " + path);
+  }
+  ptr = buffer.data();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if(mapped) munmap((void*)ptr, length);
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Read-only view of a whole file. The file is memory-mapped where
+// supported and read into memory otherwise (Windows).
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile &operator=(const MappedFile&) = delete;
+
+  const char *data() const { return ptr; }
+  size_t size() const { return length; }
+
+private:
+  const char *ptr;
+  size_t length;
+  bool mapped;
+  std::vector<char> buffer;
+};
+
+#endif
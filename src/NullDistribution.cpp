@@ -0,0 +1,117 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include "NullDistribution.h"
+
+// File layout: header followed by the maxima of each query and type in
+// repetition order, as int32 in native byte order.
+namespace {
+  const char MAGIC[8] = {'C', 'O', 'N', 'V', 'A', 'Q', 'N', 'L'};
+  const uint32_t VERSION = 1;
+  const uint32_t ENDIAN_MARK = 0x01020304;
+
+  class NullHeader {
+  public:
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t fingerprint;
+    uint64_t nqueries;
+    uint64_t nreps;
+  };
+
+  uint64_t mul(uint64_t a, uint64_t b) {
+    if(a != 0 && b > UINT64_MAX / a) throw std::runtime_error("Invalid null distribution file: size does not match header.");
+    return a*b;
+  }
+}
+
+NullDistribution::NullDistribution(size_t nqueries, uint64_t fingerprint)
+  : nqueries(nqueries),
+    key(fingerprint),
+    nreps(0),
+    maxima(4*nqueries),
+    sorted(4*nqueries)
+{}
+
+NullDistribution::NullDistribution(const std::string &path) {
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if(!in) throw std::runtime_error("Cannot open file: " + path);
+
+  NullHeader h;
+  in.read((char*)&h, sizeof(h));
+  if(!in || memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0) throw std::runtime_error("Invalid null distribution file: " + path);
+  if(h.byte_order != ENDIAN_MARK) throw std::runtime_error("Invalid null distribution file: written on a machine with different byte order.");
+  if(h.version != VERSION) {
+    throw std::runtime_error("Unsupported null distribution version " + std::to_string(h.version) + ", expected " + std::to_string(VERSION) + ".");
+  }
+
+  // check the size before allocating anything
+  in.seekg(0, std::ios::end);
+  uint64_t size = in.tellg();
+  in.seekg(sizeof(h));
+  if(h.nqueries > size || h.nreps > size || size - sizeof(h) != mul(mul(4*sizeof(int32_t), h.nqueries), h.nreps)) {
+    throw std::runtime_error("Invalid null distribution file: size does not match header.");
+  }
+
+  nqueries = h.nqueries;
+  key = h.fingerprint;
+  nreps = h.nreps;
+  maxima.resize(4*nqueries);
+  sorted.resize(4*nqueries);
+  for(std::vector<int32_t> &m : maxima) {
+    m.resize(nreps);
+    in.read((char*)m.data(), nreps*sizeof(int32_t));
+  }
+  if(!in) throw std::runtime_error("Invalid null distribution file: file is truncated.");
+
+  for(size_t k = 0; k < maxima.size(); ++k) {
+    sorted[k] = maxima[k];
+    std::sort(sorted[k].begin(), sorted[k].end());
+  }
+}
+
+void NullDistribution::save(const std::string &path) const {
+  NullHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.byte_order = ENDIAN_MARK;
+  h.fingerprint = key;
+  h.nqueries = nqueries;
+  h.nreps = nreps;
+
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  if(!out) throw std::runtime_error("Cannot open file for writing: " + path);
+  out.write((const char*)&h, sizeof(h));
+  for(const std::vector<int32_t> &m : maxima) out.write((const char*)m.data(), m.size()*sizeof(int32_t));
+  out.close();
+  if(!out) throw std::runtime_error("Cannot write file: " + path);
+}
+
+void NullDistribution::add(const std::vector<std::vector<int>> &batch) {
+  for(size_t k = 0; k < maxima.size(); ++k) {
+    maxima[k].insert(maxima[k].end(), batch[k].begin(), batch[k].end());
+
+    size_t middle = sorted[k].size();
+    sorted[k].insert(sorted[k].end(), batch[k].begin(), batch[k].end());
+    std::sort(sorted[k].begin() + middle, sorted[k].end());
+    std::inplace_merge(sorted[k].begin(), sorted[k].begin() + middle, sorted[k].end());
+  }
+  if(!batch.empty()) nreps += batch[0].size();
+}
+
+size_t NullDistribution::memory_usage() const {
+  size_t bytes = 0;
+  for(const std::vector<int32_t> &m : maxima) bytes += m.capacity() * sizeof(int32_t);
+  for(const std::vector<int32_t> &s : sorted) bytes += s.capacity() * sizeof(int32_t);
+  return bytes;
+}
+
+size_t NullDistribution::count(int query, int type, int length) const {
+  const std::vector<int32_t> &s = sorted[4*query + type];
+  return s.end() - std::lower_bound(s.begin(), s.end(), length);
+}
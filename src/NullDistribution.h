@@ -0,0 +1,48 @@
+#ifndef NULL_DISTRIBUTION_H
+#define NULL_DISTRIBUTION_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Longest permuted result of each query and type in every repetition of
+// the q-value permutations. The maxima are kept sorted, so the number of
+// repetitions reaching a given length is found by binary search.
+//
+// The distribution only depends on the segments, the model and the merge
+// settings, which are identified by a fingerprint. It can be saved and
+// loaded again to reuse or extend earlier permutations.
+class NullDistribution {
+public:
+  NullDistribution(size_t nqueries, uint64_t fingerprint);
+
+  // Loads a distribution written by save(). Throws std::runtime_error if
+  // the file is not a valid null distribution.
+  explicit NullDistribution(const std::string &path);
+
+  void save(const std::string &path) const;
+
+  uint64_t fingerprint() const { return key; }
+  size_t queries() const { return nqueries; }
+  size_t size() const { return nreps; }
+  size_t memory_usage() const;
+
+  // Appends repetitions. batch holds the maxima of each repetition, one
+  // entry per query and type (4*query + type), 0 where nothing was found.
+  void add(const std::vector<std::vector<int>> &batch);
+
+  // Number of repetitions whose longest result of the query and type is
+  // at least length.
+  size_t count(int query, int type, int length) const;
+
+private:
+  size_t nqueries;
+  uint64_t key;
+  size_t nreps;
+  // maxima of each query and type in repetition order and sorted
+  std::vector<std::vector<int32_t>> maxima;
+  std::vector<std::vector<int32_t>> sorted;
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include "PermutationEngine.h"
+#include "get_regions.h"
+#include "defines.h"
+#include "Event.h"
+
+PermutationEngine::PermutationEngine(
+  const std::vector<ChromosomeSegments> &chrs,
+  int npatients1,
+  int npatients2,
+  bool all_events
+) {
+  npatients[0] = npatients1;
+  npatients[1] = npatients2;
+  int total = npatients1 + npatients2;
+
+  std::vector<unsigned char> state(total);
+  std::vector<int> active(total);
+
+  std::vector<Event> events;
+  for(const ChromosomeSegments &chr : chrs) {
+    events.clear();
+    get_events(*chr.tables[0], chr.rows[0], 0, events);
+    get_events(*chr.tables[1], chr.rows[1], 1, events);
+    sort_events(events);
+
+    chromosomes.emplace_back();
+    ChromosomeFlips &c = chromosomes.back();
+    c.chr = chr.chr;
+
+    std::fill(state.begin(), state.end(), 0);
+    std::fill(active.begin(), active.end(), 0);
+
+    size_t i = 0;
+    while(i < events.size()) {
+      int position = events[i].position;
+      c.positions.push_back(position);
+      c.offsets.push_back(c.flips.size());
+      for(; i < events.size() && events[i].position == position; ++i) {
+        const Event &e = events[i];
+        int patient = e.group == 0 ? e.patient : npatients1 + e.patient;
+        unsigned char mask = 1 << e.type;
+        if(((state[patient] & mask) != 0) == e.isStart) {
+          if(all_events) c.flips.emplace_back(patient, e.type, 0);
+          continue;
+        }
+        state[patient] ^= mask;
+        if(e.isStart) {
+          c.flips.emplace_back(patient, e.type, 1);
+          if(active[patient]++ == 0) c.flips.emplace_back(patient, Normal, -1);
+        } else {
+          c.flips.emplace_back(patient, e.type, -1);
+          if(--active[patient] == 0) c.flips.emplace_back(patient, Normal, 1);
+        }
+      }
+    }
+    c.offsets.push_back(c.flips.size());
+  }
+}
+
+PermutationEngine::PermutationEngine(
+  std::vector<ChromosomeFlips> chromosomes,
+  int npatients1,
+  int npatients2
+) : chromosomes(std::move(chromosomes)) {
+  npatients[0] = npatients1;
+  npatients[1] = npatients2;
+}
+
+size_t PermutationEngine::memory_usage() const {
+  size_t bytes = chromosomes.capacity() * sizeof(ChromosomeFlips);
+  for(const ChromosomeFlips &c : chromosomes) {
+    bytes += c.positions.capacity() * sizeof(int);
+    bytes += c.offsets.capacity() * sizeof(size_t);
+    bytes += c.flips.capacity() * sizeof(Flip);
+  }
+  return bytes;
+}
+
+void PermutationEngine::hash(Fingerprint &fingerprint) const {
+  fingerprint.add(npatients[0]);
+  fingerprint.add(npatients[1]);
+  for(const ChromosomeFlips &c : chromosomes) {
+    if(c.positions.empty()) continue;
+    fingerprint.add(c.chr);
+    fingerprint.add(c.positions);
+    for(size_t offset : c.offsets) fingerprint.add((uint64_t)offset);
+    for(const Flip &f : c.flips) {
+      fingerprint.add(f.patient);
+      fingerprint.add(f.type);
+      fingerprint.add(f.delta);
+    }
+  }
+}
+
+void PermutationEngine::get_regions(const std::vector<int> &groups, std::vector<Region> &regions) const {
+  regions.clear();
+  for(const ChromosomeFlips &c : chromosomes) {
+    Counts counts = {{ {{0, 0, 0, npatients[0]}}, {{0, 0, 0, npatients[1]}} }};
+    for(size_t i = 0; i+1 < c.positions.size(); ++i) {
+      for(size_t j = c.offsets[i]; j < c.offsets[i+1]; ++j) {
+        const Flip &f = c.flips[j];
+        counts[groups[f.patient]][f.type] += f.delta;
+      }
+      int currentPos = c.positions[i];
+      int nextPos = c.positions[i+1];
+      regions.emplace_back(c.chr, currentPos, nextPos-1, nextPos-currentPos+1, counts, nullptr, 0);
+    }
+  }
+}
+
+void PermutationEngine::get_results(
+  const std::vector<int> &groups,
+  const RegionModel &model,
+  bool merge,
+  unsigned int merge_threshold,
+  std::vector<CNVR> &results
+) const {
+  AdjacentMerger merger(merge_threshold);
+  results.clear();
+  for(const ChromosomeFlips &c : chromosomes) {
+    Counts counts = {{ {{0, 0, 0, npatients[0]}}, {{0, 0, 0, npatients[1]}} }};
+    for(size_t i = 0; i+1 < c.positions.size(); ++i) {
+      for(size_t j = c.offsets[i]; j < c.offsets[i+1]; ++j) {
+        const Flip &f = c.flips[j];
+        counts[groups[f.patient]][f.type] += f.delta;
+      }
+      int currentPos = c.positions[i];
+      int nextPos = c.positions[i+1];
+      Region region(c.chr, currentPos, nextPos-1, nextPos-currentPos+1, counts, nullptr, 0);
+      size_t first = results.size();
+      model(region, results);
+      for(size_t k = first; k < results.size(); ++k) results[k].regions.clear();
+      if(merge) merger.add(results, first);
+    }
+  }
+}
+
+// Permutations in which a bit-sliced counter is at most bound.
+static uint64_t at_most(const uint64_t *planes, size_t nplanes, int bound) {
+  if(bound < 0) return 0;
+  if((uint64_t)bound >= ((uint64_t)1 << nplanes) - 1) return ~(uint64_t)0;
+  uint64_t less = 0;
+  uint64_t equal = ~(uint64_t)0;
+  for(size_t k = nplanes; k-- > 0;) {
+    if((bound >> k) & 1) {
+      less |= equal & ~planes[k];
+      equal &= planes[k];
+    } else {
+      equal &= ~planes[k];
+    }
+  }
+  return less | equal;
+}
+
+void PermutationEngine::get_batch_results(
+  const std::vector<uint64_t> &masks,
+  size_t n,
+  const RegionModel &model,
+  const HitBounds *bounds,
+  bool merge,
+  unsigned int merge_threshold,
+  std::vector<std::vector<CNVR>> &results
+) const {
+  uint64_t lanes = n < BATCH_SIZE ? ((uint64_t)1 << n) - 1 : ~(uint64_t)0;
+  std::vector<AdjacentMerger> mergers(n, AdjacentMerger(merge_threshold));
+  results.resize(n);
+  for(size_t r = 0; r < n; ++r) results[r].clear();
+
+  // Group 1 counts of each type are kept for all permutations as bit-sliced
+  // counters: bit r of plane k is bit k of the count in permutation r. A
+  // flip adds or subtracts a patient's mask with a short carry chain, and
+  // bounds are compared bit-serially for the whole batch. Group 2 counts
+  // follow from the totals, which do not depend on the permutation.
+  size_t nplanes = 1;
+  while(((uint64_t)1 << nplanes) <= (uint64_t)npatients[0]) ++nplanes;
+  std::vector<uint64_t> planes(4*nplanes);
+  int total[4];
+  for(const ChromosomeFlips &c : chromosomes) {
+    std::fill(planes.begin(), planes.end(), 0);
+    for(size_t k = 0; k < nplanes; ++k) {
+      if((npatients[0] >> k) & 1) planes[Normal*nplanes + k] = ~(uint64_t)0;
+    }
+    total[Gain] = total[Loss] = total[LOH] = 0;
+    total[Normal] = npatients[0] + npatients[1];
+
+    for(size_t i = 0; i+1 < c.positions.size(); ++i) {
+      for(size_t j = c.offsets[i]; j < c.offsets[i+1]; ++j) {
+        const Flip &f = c.flips[j];
+        if(f.delta == 0) continue;
+        uint64_t *p = &planes[f.type*nplanes];
+        uint64_t carry = masks[f.patient];
+        total[f.type] += f.delta;
+        if(f.delta > 0) {
+          for(size_t k = 0; carry != 0 && k < nplanes; ++k) {
+            uint64_t next = p[k] & carry;
+            p[k] ^= carry;
+            carry = next;
+          }
+        } else {
+          for(size_t k = 0; carry != 0 && k < nplanes; ++k) {
+            uint64_t next = ~p[k] & carry;
+            p[k] ^= carry;
+            carry = next;
+          }
+        }
+      }
+
+      // permutations whose counts may produce results
+      uint64_t keep = lanes;
+      if(bounds != nullptr) {
+        keep = 0;
+        for(size_t type = 0; type < 3; ++type) {
+          const uint64_t *p = &planes[type*nplanes];
+          keep |= at_most(p, nplanes, bounds->low(type, total[type]));
+          keep |= ~at_most(p, nplanes, bounds->high(type, total[type]) - 1);
+        }
+        keep &= lanes;
+      }
+
+      int currentPos = c.positions[i];
+      int nextPos = c.positions[i+1];
+      for(; keep != 0; keep &= keep - 1) {
+        size_t r = __builtin_ctzll(keep);
+        Counts region_counts;
+        for(size_t type = 0; type < 4; ++type) {
+          int count = 0;
+          for(size_t k = 0; k < nplanes; ++k) {
+            count |= (int)((planes[type*nplanes + k] >> r) & 1) << k;
+          }
+          region_counts[0][type] = count;
+          region_counts[1][type] = total[type] - count;
+        }
+        Region region(c.chr, currentPos, nextPos-1, nextPos-currentPos+1, region_counts, nullptr, 0);
+        std::vector<CNVR> &out = results[r];
+        size_t first = out.size();
+        model(region, out);
+        for(size_t k = first; k < out.size(); ++k) out[k].regions.clear();
+        if(merge) mergers[r].add(out, first);
+      }
+    }
+  }
+}
+
+void PermutationEngine::get_contrast_results(
+  const std::vector<int> &labels,
+  const std::vector<Contrast> &contrasts,
+  const std::vector<RegionModel> &models,
+  bool merge,
+  unsigned int merge_threshold,
+  std::vector<CNVR> &results
+) const {
+  std::vector<int> sizes;
+  for(int g : labels) {
+    if((size_t)g >= sizes.size()) sizes.resize(g + 1, 0);
+    ++sizes[g];
+  }
+
+  AdjacentMerger merger(merge_threshold);
+  results.clear();
+  GroupCounts counts(sizes.size());
+  for(const ChromosomeFlips &c : chromosomes) {
+    for(size_t g = 0; g < sizes.size(); ++g) counts[g] = {{0, 0, 0, sizes[g]}};
+    ContrastSweep sweep(contrasts, labels);
+    for(size_t i = 0; i < c.positions.size(); ++i) {
+      for(size_t j = c.offsets[i]; j < c.offsets[i+1]; ++j) sweep.touch(c.flips[j].patient);
+
+      int position = c.positions[i];
+      size_t first = results.size();
+      sweep.end([&](size_t q, int start, const Counts &region_counts) {
+        Region region(c.chr, start, position-1, position-start+1, region_counts, nullptr, 0);
+        size_t from = results.size();
+        models[q](region, results);
+        for(size_t k = from; k < results.size(); ++k) {
+          results[k].query = q;
+          results[k].regions.clear();
+        }
+      });
+      if(merge) merger.add(results, first);
+
+      for(size_t j = c.offsets[i]; j < c.offsets[i+1]; ++j) {
+        const Flip &f = c.flips[j];
+        counts[labels[f.patient]][f.type] += f.delta;
+      }
+      if(i+1 < c.positions.size()) sweep.begin(position, counts);
+    }
+  }
+}
@@ -0,0 +1,121 @@
+#ifndef PERMUTATION_ENGINE_H
+#define PERMUTATION_ENGINE_H
+
+#include <vector>
+#include <cstdint>
+#include "Region.h"
+#include "get_regions.h"
+#include "Fingerprint.h"
+#include "HitBounds.h"
+
+// Change in the count of a type caused by a single patient at a breakpoint.
+// Patients are numbered globally: group 1 first, followed by group 2.
+class Flip {
+public:
+  int patient;
+  int type;
+  int delta;
+
+  Flip(int patient, int type, int delta)
+    : patient(patient),
+      type(type),
+      delta(delta)
+  {}
+};
+
+// Events of one chromosome, sorted once and reduced to the state flips
+// taking place at each breakpoint. Flips in [offsets[i], offsets[i+1])
+// happen at positions[i].
+class ChromosomeFlips {
+public:
+  int chr;
+  std::vector<int> positions;
+  std::vector<size_t> offsets;
+  std::vector<Flip> flips;
+};
+
+// Computes regions for permuted group labels. Breakpoints do not depend on
+// which group a patient belongs to, so each permutation is a single linear
+// pass over the pre-sorted flips using a patient to group table.
+class PermutationEngine {
+public:
+  // Number of permutations evaluated together by get_batch_results.
+  static const size_t BATCH_SIZE = 64;
+
+  // With all_events set, events that do not change the state of their
+  // patient are kept as flips with delta 0, so the patients with events at
+  // each breakpoint are known, as needed by get_contrast_results.
+  PermutationEngine(
+    const std::vector<ChromosomeSegments> &chromosomes,
+    int npatients1,
+    int npatients2,
+    bool all_events
+  );
+
+  // Uses flips computed earlier, e.g. read from a cohort index.
+  PermutationEngine(
+    std::vector<ChromosomeFlips> chromosomes,
+    int npatients1,
+    int npatients2
+  );
+
+  int patients() const { return npatients[0] + npatients[1]; }
+  int patients(size_t group) const { return npatients[group]; }
+  const std::vector<ChromosomeFlips> &flips() const { return chromosomes; }
+
+  // Bytes allocated for the flips.
+  size_t memory_usage() const;
+
+  // Adds the group sizes and flips, which determine all permuted regions.
+  void hash(Fingerprint &fingerprint) const;
+
+  // groups[i] is the group (0 or 1) of global patient i.
+  // Regions carry counts only and no patient states.
+  void get_regions(const std::vector<int> &groups, std::vector<Region> &regions) const;
+
+  // Evaluates the model on each permuted region without storing regions.
+  // The resulting CNVRs do not reference any regions. With merge set,
+  // adjacent results are merged as they are found.
+  void get_results(
+    const std::vector<int> &groups,
+    const RegionModel &model,
+    bool merge,
+    unsigned int merge_threshold,
+    std::vector<CNVR> &results
+  ) const;
+
+  // Evaluates n <= BATCH_SIZE permutations in one pass over the flips. Bit
+  // r of masks[i] is set if global patient i is in group 1 in permutation
+  // r. results[r] receives the results of permutation r as by get_results.
+  // If bounds is set, the model is only evaluated on the permutations whose
+  // counts may produce results.
+  void get_batch_results(
+    const std::vector<uint64_t> &masks,
+    size_t n,
+    const RegionModel &model,
+    const HitBounds *bounds,
+    bool merge,
+    unsigned int merge_threshold,
+    std::vector<std::vector<CNVR>> &results
+  ) const;
+
+  // Multi-group counterpart of get_results for an engine built with all
+  // patients in group 1 and all_events set. Regions of each contrast
+  // follow the breakpoints of its patients, as in stream_contrasts. labels[i] is the group of global patient i, and
+  // models[c] is evaluated on the counts of contrasts[c], tagging results
+  // with query c.
+  void get_contrast_results(
+    const std::vector<int> &labels,
+    const std::vector<Contrast> &contrasts,
+    const std::vector<RegionModel> &models,
+    bool merge,
+    unsigned int merge_threshold,
+    std::vector<CNVR> &results
+  ) const;
+
+private:
+  int npatients[2];
+  std::vector<ChromosomeFlips> chromosomes;
+};
+
+#endif
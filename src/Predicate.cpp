@@ -1,37 +1,68 @@
-#include <numeric>
+#include <vector>
+#include <algorithm>
 #include "defines.h"
 #include "Predicate.h"
 
-bool comp_less(double a, double b) { return a < b; }
-bool comp_greater(double a, double b) { return a > b; }
-bool comp_leq(double a, double b) { return a <= b; }
-bool comp_geq(double a, double b) { return a >= b; }
+namespace {
+  const size_t BLOCK_SIZE = 256;
 
-bool Predicate::match(const std::vector<std::vector<bool>> &state) {
-  double freq;
-  if(type == Normal) {
-    int count = 0;
-    for(size_t i = 0; i < state[0].size(); ++i) {
-      bool any = false;
-      for(size_t type = 0; type < 3; ++type) {
-        any = any || state[type][i];
+  // Frequency test of the threshold as written, on count patients out of npatients.
+  bool test(const Threshold &t, int count, int npatients) {
+    double freq = (double)count / npatients;
+    if(t.eq == EQ_NEQ) freq = 1.0 - freq;
+    switch(t.comp) {
+      case COMP_LESS: return freq < t.value;
+      case COMP_GREATER: return freq > t.value;
+      case COMP_LEQ: return freq <= t.value;
+      case COMP_GEQ: return freq >= t.value;
+      default: return false;
+    }
+  }
+}
+
+Predicate::Predicate(const std::vector<std::vector<Threshold>> &clauses, int npatients) {
+  for(const std::vector<Threshold> &clause : clauses) {
+    for(const Threshold &t : clause) {
+      // the frequency is monotone in the count, so the matching counts
+      // form a single range. An empty range excludes every count.
+      CountBound bound;
+      bound.type = t.type;
+      bound.lo = bound.hi = npatients + 1;
+      for(int count = 0; count <= npatients; ++count) {
+        if(!test(t, count, npatients)) continue;
+        if(bound.lo > npatients) bound.lo = count;
+        bound.hi = count;
+      }
+      bounds.push_back(bound);
+    }
+    clause_end.push_back(bounds.size());
+  }
+}
+
+void Predicate::match(const Counts *counts, size_t n, size_t group, unsigned char *keep) const {
+  unsigned char any[BLOCK_SIZE];
+  unsigned char all[BLOCK_SIZE];
+
+  for(size_t first = 0; first < n; first += BLOCK_SIZE) {
+    size_t m = std::min(BLOCK_SIZE, n - first);
+    const Counts *c = counts + first;
+
+    std::fill(any, any + m, 0);
+    size_t b = 0;
+    for(size_t end : clause_end) {
+      std::fill(all, all + m, 1);
+      for(; b < end; ++b) {
+        const CountBound &bound = bounds[b];
+        for(size_t i = 0; i < m; ++i) all[i] &= in_bounds(c[i][group][bound.type], bound);
       }
-      if(!any) ++count;
+      for(size_t i = 0; i < m; ++i) any[i] |= all[i];
     }
-    freq = (double)count / state[0].size();
-  } else {
-    freq = (double)std::accumulate(state[type].begin(), state[type].end(), 0) / state[type].size();
+    for(size_t i = 0; i < m; ++i) keep[first + i] &= any[i];
   }
-  if(eq == EQ_NEQ) freq = 1.0 - freq;
-  return f_comp(freq, value);
 }
 
-Predicate make_predicate(COMPARISON comp, double value, EQUALITY eq, VARIATION_TYPE type) {
-  std::function<bool(double,double)> f_comp;
-  if(comp == COMP_LESS) f_comp = comp_less;
-  else if(comp == COMP_GREATER) f_comp = comp_greater;
-  else if(comp == COMP_LEQ) f_comp = comp_leq;
-  else if(comp == COMP_GEQ) f_comp = comp_geq;
-  
-  return Predicate(f_comp, value, eq, type);
+Predicate make_predicate(COMPARISON comp, double value, EQUALITY eq, VARIATION_TYPE type, int npatients) {
+  std::vector<std::vector<Threshold>> clauses(1);
+  clauses[0].emplace_back(comp, value, eq, type);
+  return Predicate(clauses, npatients);
 }
@@ -2,31 +2,70 @@
 #define PREDICATE_H
 
 #include <vector>
-#include <functional>
+#include <cstddef>
 #include "defines.h"
+#include "Region.h"
 
-class Predicate {
+// A single threshold "[COMP] [FREQ] [EQ] [TYPE]" of a predicate.
+class Threshold {
 public:
-  std::function<bool(double,double)> f_comp;
+  COMPARISON comp;
   double value;
   EQUALITY eq;
-  VARIATION_TYPE type; 
-  
-  Predicate(
-    std::function<bool(double,double)> f_comp,
-    double value,
-    EQUALITY eq,
-    VARIATION_TYPE type
-  )
-    : f_comp(f_comp),
+  VARIATION_TYPE type;
+
+  Threshold(COMPARISON comp, double value, EQUALITY eq, VARIATION_TYPE type)
+    : comp(comp),
       value(value),
       eq(eq),
       type(type)
   {}
-    
-  bool match(const std::vector<std::vector<bool>> &state);
 };
 
-Predicate make_predicate(COMPARISON comp, double value, EQUALITY eq, VARIATION_TYPE type);
+// Bounds lo <= count <= hi on the number of patients of a type.
+class CountBound {
+public:
+  int type;
+  int lo;
+  int hi;
+};
+
+// Predicate on the counts of one group, compiled for a fixed group size.
+// Every threshold is turned into an exact bound on the count of its type.
+// The predicate holds if all bounds of any clause hold.
+class Predicate {
+public:
+  Predicate() {}
+  Predicate(const std::vector<std::vector<Threshold>> &clauses, int npatients);
+
+  bool match(const Region &region, size_t group) const {
+    return match(region.counts[group]);
+  }
+
+  bool match(const std::array<int, 4> &counts) const {
+    // evaluates every bound without branching on intermediate results
+    bool any = false;
+    size_t b = 0;
+    for(size_t end : clause_end) {
+      bool all = true;
+      for(; b < end; ++b) all &= in_bounds(counts[bounds[b].type], bounds[b]);
+      any |= all;
+    }
+    return any;
+  }
+
+  // Clears keep[i] for each of the n regions whose counts do not match.
+  void match(const Counts *counts, size_t n, size_t group, unsigned char *keep) const;
+
+private:
+  std::vector<CountBound> bounds;
+  std::vector<size_t> clause_end;
+
+  static bool in_bounds(int count, const CountBound &bound) {
+    return (unsigned int)(count - bound.lo) <= (unsigned int)(bound.hi - bound.lo);
+  }
+};
+
+Predicate make_predicate(COMPARISON comp, double value, EQUALITY eq, VARIATION_TYPE type, int npatients);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,27 @@
+#include <algorithm>
+#include <numeric>
+#include "Profile.h"
+
+void Profile::start(const std::string &stage) {
+  stop();
+  stages.push_back(stage);
+  seconds.push_back(0);
+  began = std::chrono::steady_clock::now();
+  running = true;
+}
+
+void Profile::stop() {
+  if(!running) return;
+  seconds.back() = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+  running = false;
+}
+
+void Profile::memory(const std::string &component, size_t n) {
+  size_t i = std::find(components.begin(), components.end(), component) - components.begin();
+  if(i == components.size()) {
+    components.push_back(component);
+    bytes.push_back(0);
+  }
+  bytes[i] = n;
+  peak = std::max(peak, std::accumulate(bytes.begin(), bytes.end(), (size_t)0));
+}
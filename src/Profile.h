@@ -0,0 +1,55 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstddef>
+
+// Wall time of each stage of a run, together with counters and estimates
+// of the memory held by its main data structures.
+class Profile {
+public:
+  Profile() : results(0), permutations(0), permutation_seconds(0), threads(0), peak(0), running(false) {}
+
+  // Ends the running stage, if any, and starts timing the named one.
+  void start(const std::string &stage);
+
+  // Ends the running stage.
+  void stop();
+
+  // Sets the bytes held by a component and updates the peak of the total
+  // over all components.
+  void memory(const std::string &component, size_t bytes);
+
+  std::vector<std::string> stages;
+  std::vector<double> seconds;
+
+  // per chromosome, events is 0 where unknown, pruned regions are rejected
+  // on their counts without evaluating the model
+  std::vector<int> chromosomes;
+  std::vector<size_t> events;
+  std::vector<size_t> regions;
+  std::vector<size_t> pruned;
+  std::vector<size_t> hits;
+
+  size_t results;
+  size_t permutations;
+  double permutation_seconds;
+  unsigned int threads;
+
+  // q-value repetitions evaluated by each worker and the seconds it spent
+  // evaluating them, empty if no q-values were computed
+  std::vector<size_t> worker_permutations;
+  std::vector<double> worker_seconds;
+
+  std::vector<std::string> components;
+  std::vector<size_t> bytes;
+  size_t peak;
+
+private:
+  std::chrono::steady_clock::time_point began;
+  bool running;
+};
+
+#endif
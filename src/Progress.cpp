@@ -0,0 +1,37 @@
+#include "Progress.h"
+
+void Progress::begin(size_t n) {
+  done = 0;
+  total = n;
+  last = std::chrono::steady_clock::now();
+  if(callback) callback(0, total);
+}
+
+bool Progress::report() {
+  if(!callback || total == 0 || error) return false;
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if(std::chrono::duration<double>(now - last).count() < interval) return false;
+  last = now;
+
+  try {
+    callback(done, total);
+  } catch(...) {
+    error = std::current_exception();
+    return true;
+  }
+  return false;
+}
+
+void Progress::end() {
+  if(callback && total > 0) callback(done, total);
+  total = 0;
+}
+
+void Progress::rethrow() {
+  if(error) {
+    std::exception_ptr e = error;
+    error = nullptr;
+    std::rethrow_exception(e);
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <cstddef>
+
+// Progress of a parallel loop. Workers call advance() as items complete,
+// while the thread waiting on the pool calls report() from the pool's
+// interrupt check, which forwards to the callback at most once per
+// interval seconds.
+class Progress {
+public:
+  typedef std::function<void(size_t done, size_t total)> Callback;
+
+  Progress() : interval(0), done(0), total(0) {}
+  Progress(Callback callback, double interval) : callback(callback), interval(interval), done(0), total(0) {}
+
+  // Starts a loop of total items and reports that none are done.
+  void begin(size_t total);
+
+  void advance(size_t n) { done += n; }
+
+  // Reports the items done so far if the interval has passed. Returns
+  // true if the callback threw, in which case the exception is kept until
+  // rethrow() and the caller should cancel the loop.
+  bool report();
+
+  // Reports the items done and ends the loop.
+  void end();
+
+  // Rethrows the exception of a failed report(), if any.
+  void rethrow();
+
+private:
+  Callback callback;
+  double interval;
+  std::atomic<size_t> done;
+  size_t total;
+  std::chrono::steady_clock::time_point last;
+  std::exception_ptr error;
+};
+
+#endif
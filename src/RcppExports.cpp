@@ -6,8 +6,8 @@
 using namespace Rcpp;
 
 // convaqCpp
-List convaqCpp(DataFrame df1, DataFrame df2, unsigned int model_num, bool qvalues, unsigned int qvalues_rep, bool merge, unsigned int merge_threshold, double cutoff, unsigned int comp1, double value1, unsigned int eq1, unsigned int type1, unsigned int comp2, double value2, unsigned int eq2, unsigned int type2, unsigned int nthreads);
-RcppExport SEXP _convaq_convaqCpp(SEXP df1SEXP, SEXP df2SEXP, SEXP model_numSEXP, SEXP qvaluesSEXP, SEXP qvalues_repSEXP, SEXP mergeSEXP, SEXP merge_thresholdSEXP, SEXP cutoffSEXP, SEXP comp1SEXP, SEXP value1SEXP, SEXP eq1SEXP, SEXP type1SEXP, SEXP comp2SEXP, SEXP value2SEXP, SEXP eq2SEXP, SEXP type2SEXP, SEXP nthreadsSEXP) {
+List convaqCpp(DataFrame df1, DataFrame df2, unsigned int model_num, bool qvalues, unsigned int qvalues_rep, unsigned int qvalues_stop, double qvalues_threshold, std::string qvalues_null, bool merge, unsigned int merge_threshold, std::vector<double> cutoff, double fisher_tol, bool full_freq, bool full_state, DataFrame pred1, DataFrame pred2, unsigned int nthreads, bool profile, SEXP progress);
+RcppExport SEXP _convaq_convaqCpp(SEXP df1SEXP, SEXP df2SEXP, SEXP model_numSEXP, SEXP qvaluesSEXP, SEXP qvalues_repSEXP, SEXP qvalues_stopSEXP, SEXP qvalues_thresholdSEXP, SEXP qvalues_nullSEXP, SEXP mergeSEXP, SEXP merge_thresholdSEXP, SEXP cutoffSEXP, SEXP fisher_tolSEXP, SEXP full_freqSEXP, SEXP full_stateSEXP, SEXP pred1SEXP, SEXP pred2SEXP, SEXP nthreadsSEXP, SEXP profileSEXP, SEXP progressSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -16,25 +16,187 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< unsigned int >::type model_num(model_numSEXP);
     Rcpp::traits::input_parameter< bool >::type qvalues(qvaluesSEXP);
     Rcpp::traits::input_parameter< unsigned int >::type qvalues_rep(qvalues_repSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type qvalues_stop(qvalues_stopSEXP);
+    Rcpp::traits::input_parameter< double >::type qvalues_threshold(qvalues_thresholdSEXP);
+    Rcpp::traits::input_parameter< std::string >::type qvalues_null(qvalues_nullSEXP);
     Rcpp::traits::input_parameter< bool >::type merge(mergeSEXP);
     Rcpp::traits::input_parameter< unsigned int >::type merge_threshold(merge_thresholdSEXP);
+    Rcpp::traits::input_parameter< std::vector<double> >::type cutoff(cutoffSEXP);
+    Rcpp::traits::input_parameter< double >::type fisher_tol(fisher_tolSEXP);
+    Rcpp::traits::input_parameter< bool >::type full_freq(full_freqSEXP);
+    Rcpp::traits::input_parameter< bool >::type full_state(full_stateSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type pred1(pred1SEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type pred2(pred2SEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type progress(progressSEXP);
+    rcpp_result_gen = Rcpp::wrap(convaqCpp(df1, df2, model_num, qvalues, qvalues_rep, qvalues_stop, qvalues_threshold, qvalues_null, merge, merge_threshold, cutoff, fisher_tol, full_freq, full_state, pred1, pred2, nthreads, profile, progress));
+    return rcpp_result_gen;
+END_RCPP
+}
+
+// cohortCpp
+SEXP cohortCpp(DataFrame df1, DataFrame df2, std::vector<std::string> labels1, std::vector<std::string> labels2, unsigned int nthreads);
+RcppExport SEXP _convaq_cohortCpp(SEXP df1SEXP, SEXP df2SEXP, SEXP labels1SEXP, SEXP labels2SEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< DataFrame >::type df1(df1SEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type df2(df2SEXP);
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type labels1(labels1SEXP);
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type labels2(labels2SEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(cohortCpp(df1, df2, labels1, labels2, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// openIndexCpp
+SEXP openIndexCpp(std::string path, bool verify);
+RcppExport SEXP _convaq_openIndexCpp(SEXP pathSEXP, SEXP verifySEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< bool >::type verify(verifySEXP);
+    rcpp_result_gen = Rcpp::wrap(openIndexCpp(path, verify));
+    return rcpp_result_gen;
+END_RCPP
+}
+// saveCohortCpp
+void saveCohortCpp(SEXP handle, std::string path);
+RcppExport SEXP _convaq_saveCohortCpp(SEXP handleSEXP, SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    saveCohortCpp(handle, path);
+    return R_NilValue;
+END_RCPP
+}
+// cohortInfoCpp
+List cohortInfoCpp(SEXP handle);
+RcppExport SEXP _convaq_cohortInfoCpp(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(cohortInfoCpp(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// convaqCohortCpp
+List convaqCohortCpp(SEXP handle, unsigned int model_num, bool qvalues, unsigned int qvalues_rep, unsigned int qvalues_stop, double qvalues_threshold, std::string qvalues_null, bool merge, unsigned int merge_threshold, std::vector<double> cutoff, double fisher_tol, bool full_freq, bool full_state, DataFrame pred1, DataFrame pred2, unsigned int nthreads, bool profile, SEXP progress);
+RcppExport SEXP _convaq_convaqCohortCpp(SEXP handleSEXP, SEXP model_numSEXP, SEXP qvaluesSEXP, SEXP qvalues_repSEXP, SEXP qvalues_stopSEXP, SEXP qvalues_thresholdSEXP, SEXP qvalues_nullSEXP, SEXP mergeSEXP, SEXP merge_thresholdSEXP, SEXP cutoffSEXP, SEXP fisher_tolSEXP, SEXP full_freqSEXP, SEXP full_stateSEXP, SEXP pred1SEXP, SEXP pred2SEXP, SEXP nthreadsSEXP, SEXP profileSEXP, SEXP progressSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type model_num(model_numSEXP);
+    Rcpp::traits::input_parameter< bool >::type qvalues(qvaluesSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type qvalues_rep(qvalues_repSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type qvalues_stop(qvalues_stopSEXP);
+    Rcpp::traits::input_parameter< double >::type qvalues_threshold(qvalues_thresholdSEXP);
+    Rcpp::traits::input_parameter< std::string >::type qvalues_null(qvalues_nullSEXP);
+    Rcpp::traits::input_parameter< bool >::type merge(mergeSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type merge_threshold(merge_thresholdSEXP);
+    Rcpp::traits::input_parameter< std::vector<double> >::type cutoff(cutoffSEXP);
+    Rcpp::traits::input_parameter< double >::type fisher_tol(fisher_tolSEXP);
+    Rcpp::traits::input_parameter< bool >::type full_freq(full_freqSEXP);
+    Rcpp::traits::input_parameter< bool >::type full_state(full_stateSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type pred1(pred1SEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type pred2(pred2SEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type progress(progressSEXP);
+    rcpp_result_gen = Rcpp::wrap(convaqCohortCpp(handle, model_num, qvalues, qvalues_rep, qvalues_stop, qvalues_threshold, qvalues_null, merge, merge_threshold, cutoff, fisher_tol, full_freq, full_state, pred1, pred2, nthreads, profile, progress));
+    return rcpp_result_gen;
+END_RCPP
+}
+// convaqContrastsCpp
+List convaqContrastsCpp(DataFrame df, std::vector<int> labels, List groups1, List groups2, unsigned int model_num, bool qvalues, unsigned int qvalues_rep, unsigned int qvalues_stop, double qvalues_threshold, bool merge, unsigned int merge_threshold, double cutoff, double fisher_tol, bool full_freq, bool full_state, DataFrame pred1, DataFrame pred2, unsigned int nthreads);
+RcppExport SEXP _convaq_convaqContrastsCpp(SEXP dfSEXP, SEXP labelsSEXP, SEXP groups1SEXP, SEXP groups2SEXP, SEXP model_numSEXP, SEXP qvaluesSEXP, SEXP qvalues_repSEXP, SEXP qvalues_stopSEXP, SEXP qvalues_thresholdSEXP, SEXP mergeSEXP, SEXP merge_thresholdSEXP, SEXP cutoffSEXP, SEXP fisher_tolSEXP, SEXP full_freqSEXP, SEXP full_stateSEXP, SEXP pred1SEXP, SEXP pred2SEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
+    Rcpp::traits::input_parameter< std::vector<int> >::type labels(labelsSEXP);
+    Rcpp::traits::input_parameter< List >::type groups1(groups1SEXP);
+    Rcpp::traits::input_parameter< List >::type groups2(groups2SEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type model_num(model_numSEXP);
+    Rcpp::traits::input_parameter< bool >::type qvalues(qvaluesSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type qvalues_rep(qvalues_repSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type qvalues_stop(qvalues_stopSEXP);
+    Rcpp::traits::input_parameter< double >::type qvalues_threshold(qvalues_thresholdSEXP);
+    Rcpp::traits::input_parameter< bool >::type merge(mergeSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type merge_threshold(merge_thresholdSEXP);
+    Rcpp::traits::input_parameter< double >::type cutoff(cutoffSEXP);
+    Rcpp::traits::input_parameter< double >::type fisher_tol(fisher_tolSEXP);
+    Rcpp::traits::input_parameter< bool >::type full_freq(full_freqSEXP);
+    Rcpp::traits::input_parameter< bool >::type full_state(full_stateSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type pred1(pred1SEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type pred2(pred2SEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(convaqContrastsCpp(df, labels, groups1, groups2, model_num, qvalues, qvalues_rep, qvalues_stop, qvalues_threshold, merge, merge_threshold, cutoff, fisher_tol, full_freq, full_state, pred1, pred2, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// benchmarkCpp
+DataFrame benchmarkCpp(DataFrame df1, DataFrame df2, double cutoff, DataFrame pred1, DataFrame pred2, unsigned int qvalues_rep, unsigned int merge_threshold, unsigned int nthreads);
+RcppExport SEXP _convaq_benchmarkCpp(SEXP df1SEXP, SEXP df2SEXP, SEXP cutoffSEXP, SEXP pred1SEXP, SEXP pred2SEXP, SEXP qvalues_repSEXP, SEXP merge_thresholdSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< DataFrame >::type df1(df1SEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type df2(df2SEXP);
     Rcpp::traits::input_parameter< double >::type cutoff(cutoffSEXP);
-    Rcpp::traits::input_parameter< unsigned int >::type comp1(comp1SEXP);
-    Rcpp::traits::input_parameter< double >::type value1(value1SEXP);
-    Rcpp::traits::input_parameter< unsigned int >::type eq1(eq1SEXP);
-    Rcpp::traits::input_parameter< unsigned int >::type type1(type1SEXP);
-    Rcpp::traits::input_parameter< unsigned int >::type comp2(comp2SEXP);
-    Rcpp::traits::input_parameter< double >::type value2(value2SEXP);
-    Rcpp::traits::input_parameter< unsigned int >::type eq2(eq2SEXP);
-    Rcpp::traits::input_parameter< unsigned int >::type type2(type2SEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type pred1(pred1SEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type pred2(pred2SEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type qvalues_rep(qvalues_repSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type merge_threshold(merge_thresholdSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(benchmarkCpp(df1, df2, cutoff, pred1, pred2, qvalues_rep, merge_threshold, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// fisherTableCpp
+List fisherTableCpp(int npatients1, int npatients2, double tolerance, unsigned int nthreads);
+RcppExport SEXP _convaq_fisherTableCpp(SEXP npatients1SEXP, SEXP npatients2SEXP, SEXP toleranceSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type npatients1(npatients1SEXP);
+    Rcpp::traits::input_parameter< int >::type npatients2(npatients2SEXP);
+    Rcpp::traits::input_parameter< double >::type tolerance(toleranceSEXP);
+    Rcpp::traits::input_parameter< unsigned int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(fisherTableCpp(npatients1, npatients2, tolerance, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// readSegmentsCpp
+DataFrame readSegmentsCpp(std::string path, bool header, unsigned int nthreads);
+RcppExport SEXP _convaq_readSegmentsCpp(SEXP pathSEXP, SEXP headerSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< bool >::type header(headerSEXP);
     Rcpp::traits::input_parameter< unsigned int >::type nthreads(nthreadsSEXP);
-    rcpp_result_gen = Rcpp::wrap(convaqCpp(df1, df2, model_num, qvalues, qvalues_rep, merge, merge_threshold, cutoff, comp1, value1, eq1, type1, comp2, value2, eq2, type2, nthreads));
+    rcpp_result_gen = Rcpp::wrap(readSegmentsCpp(path, header, nthreads));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_convaq_convaqCpp", (DL_FUNC) &_convaq_convaqCpp, 17},
+    {"_convaq_convaqCpp", (DL_FUNC) &_convaq_convaqCpp, 19},
+    {"_convaq_cohortCpp", (DL_FUNC) &_convaq_cohortCpp, 5},
+    {"_convaq_openIndexCpp", (DL_FUNC) &_convaq_openIndexCpp, 2},
+    {"_convaq_saveCohortCpp", (DL_FUNC) &_convaq_saveCohortCpp, 2},
+    {"_convaq_cohortInfoCpp", (DL_FUNC) &_convaq_cohortInfoCpp, 1},
+    {"_convaq_convaqCohortCpp", (DL_FUNC) &_convaq_convaqCohortCpp, 18},
+    {"_convaq_convaqContrastsCpp", (DL_FUNC) &_convaq_convaqContrastsCpp, 18},
+    {"_convaq_benchmarkCpp", (DL_FUNC) &_convaq_benchmarkCpp, 8},
+    {"_convaq_fisherTableCpp", (DL_FUNC) &_convaq_fisherTableCpp, 4},
+    {"_convaq_readSegmentsCpp", (DL_FUNC) &_convaq_readSegmentsCpp, 3},
     {NULL, NULL, 0}
 };
 
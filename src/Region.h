@@ -1,25 +1,42 @@
 #ifndef REGION_H
 #define REGION_H
 
-#include <string>
 #include <vector>
+#include <array>
 #include <algorithm>
+#include "StateArena.h"
+
+// Number of patients in each group with a given variation type (Gain, Loss,
+// LOH or Normal) in a region.
+typedef std::array<std::array<int, 4>, 2> Counts;
 
 class Region {
 public:
-  std::string chr;
+  int chr;
   int start;
   int end;
   int length;
-  std::vector<std::vector<std::vector<bool>>> state;
+  Counts counts;
+  const StateArena *states;
+  size_t index;
 
-  Region(const std::string &chr, int start, int end, int length, const std::vector<std::vector<std::vector<bool>>> &state)
+  Region(int chr, int start, int end, int length, const Counts &counts, const StateArena *states, size_t index)
     : chr(chr),
       start(start),
       end(end),
       length(length),
-      state(state)
+      counts(counts),
+      states(states),
+      index(index)
   {}
+
+  int count(size_t group, size_t type) const {
+    return counts[group][type];
+  }
+
+  bool has(size_t group, size_t type, size_t patient) const {
+    return states->test(index, group, type, patient);
+  }
 };
 
 #endif
@@ -0,0 +1,140 @@
+#include <Rcpp.h>
+#include <vector>
+#include "ResultBuilder.h"
+
+using namespace Rcpp;
+
+ResultBuilder::ResultBuilder(
+  const std::vector<CNVR> &results,
+  const ChromosomeIndex &chromosomes,
+  int npatients1,
+  int npatients2,
+  ThreadPool &pool
+)
+  : results(results),
+    chromosomes(chromosomes),
+    pool(pool)
+{
+  npatients[0] = npatients1;
+  npatients[1] = npatients2;
+}
+
+DataFrame ResultBuilder::regions() const {
+  size_t n = results.size();
+
+  // one CHARSXP per chromosome, shared by all rows
+  CharacterVector names(chromosomes.size());
+  for(size_t i = 0; i < chromosomes.size(); ++i) names[i] = chromosomes.name(i);
+
+  CharacterVector chr(n);
+  IntegerVector query(n), start(n), end(n), length(n), type(n);
+  NumericVector pvalue(n), qvalue(n);
+
+  for(size_t i = 0; i < n; ++i) {
+    const CNVR &r = results[i];
+    query[i] = r.query + 1;
+    chr[i] = names[r.chr];
+    start[i] = r.start;
+    end[i] = r.end;
+    length[i] = r.length;
+    type[i] = r.type;
+    pvalue[i] = r.pvalue;
+    qvalue[i] = r.qvalue;
+  }
+
+  return DataFrame::create(
+    Named("query") = query,
+    Named("chr") = chr,
+    Named("start") = start,
+    Named("end") = end,
+    Named("length") = length,
+    Named("type") = type,
+    Named("pvalue") = pvalue,
+    Named("qvalue") = qvalue
+  );
+}
+
+List ResultBuilder::freq_range() const {
+  size_t n = results.size();
+  NumericMatrix freq_min(n, 6);
+  NumericMatrix freq_max(n, 6);
+  double *pmin = REAL(freq_min);
+  double *pmax = REAL(freq_max);
+
+  pool.parallel_for(n, [&](size_t i) {
+    for(size_t group = 0; group < 2; ++group) {
+      for(size_t type = 0; type < 3; ++type) {
+        size_t col = 3*group + type;
+        results[i].get_freq_range(group, type, pmin[col*n + i], pmax[col*n + i]);
+      }
+    }
+  });
+
+  return List::create(
+    Named("min") = freq_min,
+    Named("max") = freq_max
+  );
+}
+
+List ResultBuilder::state_mask() const {
+  size_t n = results.size();
+  List out(2);
+  for(size_t group = 0; group < 2; ++group) {
+    IntegerMatrix mask(n, npatients[group]);
+    int *p = INTEGER(mask);
+
+    pool.parallel_for(n, [&](size_t i) {
+      std::vector<unsigned int> m = results[i].get_state_mask(group);
+      for(size_t j = 0; j < m.size(); ++j) p[j*n + i] = m[j];
+    });
+
+    out[group] = mask;
+  }
+  return out;
+}
+
+List ResultBuilder::full_freq() const {
+  size_t n = results.size();
+  std::vector<std::vector<std::vector<double>>> freqs(n);
+  pool.parallel_for(n, [&](size_t i) {
+    for(size_t group = 0; group < 2; ++group) {
+      for(size_t type = 0; type < 3; ++type) {
+        freqs[i].push_back(results[i].get_freq(group, type));
+      }
+    }
+  });
+
+  List out(n);
+  for(size_t i = 0; i < n; ++i) {
+    List region_freq(2);
+    for(size_t group = 0; group < 2; ++group) {
+      List group_freq(3);
+      for(size_t type = 0; type < 3; ++type) {
+        group_freq[type] = freqs[i][3*group + type];
+      }
+      region_freq[group] = group_freq;
+    }
+    out[i] = region_freq;
+  }
+  return out;
+}
+
+List ResultBuilder::full_state() const {
+  size_t n = results.size();
+  std::vector<std::vector<std::vector<std::vector<unsigned int>>>> states(n);
+  pool.parallel_for(n, [&](size_t i) {
+    for(size_t group = 0; group < 2; ++group) {
+      states[i].push_back(results[i].get_state(group));
+    }
+  });
+
+  List out(n);
+  for(size_t i = 0; i < n; ++i) {
+    List r_state(2);
+    for(size_t group = 0; group < 2; ++group) {
+      r_state[group] = states[i][group];
+    }
+    out[i] = r_state;
+  }
+  return out;
+}
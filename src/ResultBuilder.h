@@ -0,0 +1,47 @@
+#ifndef RESULT_BUILDER_H
+#define RESULT_BUILDER_H
+
+#include <Rcpp.h>
+#include <vector>
+#include "CNVR.h"
+#include "ChromosomeIndex.h"
+#include "ThreadPool.h"
+
+// Converts results to R objects. Every output is allocated once at its
+// final size and columnar data is filled in place by the thread pool.
+class ResultBuilder {
+public:
+  ResultBuilder(
+    const std::vector<CNVR> &results,
+    const ChromosomeIndex &chromosomes,
+    int npatients1,
+    int npatients2,
+    ThreadPool &pool
+  );
+
+  // Data frame with one row per result. Queries are numbered from 1.
+  Rcpp::DataFrame regions() const;
+
+  // Results x 6 matrices of the smallest and largest within-group
+  // frequency of each type. Columns are group 1 Gain, Loss, LOH
+  // followed by group 2 Gain, Loss, LOH.
+  Rcpp::List freq_range() const;
+
+  // One results x patients integer matrix per group holding the bitmask
+  // (1 << type) of the types observed for each patient.
+  Rcpp::List state_mask() const;
+
+  // Sorted frequencies of every region in each result, per group and type.
+  Rcpp::List full_freq() const;
+
+  // Sets of observed types per patient for each result and group.
+  Rcpp::List full_state() const;
+
+private:
+  const std::vector<CNVR> &results;
+  const ChromosomeIndex &chromosomes;
+  int npatients[2];
+  ThreadPool &pool;
+};
+
+#endif
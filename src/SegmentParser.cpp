@@ -0,0 +1,233 @@
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+#include <climits>
+#include <cstring>
+#include "SegmentParser.h"
+#include "ChromosomeIndex.h"
+#include "defines.h"
+
+namespace {
+  const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+  // Returns the end of the line starting at p, excluding the newline.
+  const char *line_end(const char *p, const char *end) {
+    const char *q = (const char*)memchr(p, '\n', end - p);
+    return q == NULL ? end : q;
+  }
+
+  const char *next_line(const char *p, const char *end) {
+    p = line_end(p, end);
+    return p == end ? end : p + 1;
+  }
+
+  bool is_record(const char *p, const char *eol) {
+    if(eol > p && eol[-1] == '\r') --eol;
+    return p < eol && *p != '#';
+  }
+
+  // Maps names to local ids. Consecutive records usually share names,
+  // so the previous name is checked before hashing.
+  class Dictionary {
+  public:
+    std::vector<std::string> names;
+
+    int get(const char *s, size_t n) {
+      if(last >= 0 && names[last].size() == n && memcmp(names[last].data(), s, n) == 0) return last;
+      key.assign(s, n);
+      auto it = ids.find(key);
+      if(it == ids.end()) {
+        it = ids.emplace(key, names.size()).first;
+        names.push_back(key);
+      }
+      last = it->second;
+      return last;
+    }
+
+  private:
+    std::unordered_map<std::string, int> ids;
+    std::string key;
+    int last = -1;
+  };
+
+  bool parse_int(const char *p, const char *end, int &value) {
+    bool negative = false;
+    if(p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if(p == end) return false;
+    long long x = 0;
+    for(; p < end; ++p) {
+      if(*p < '0' || *p > '9') return false;
+      x = 10*x + (*p - '0');
+      if(x > INT_MAX) return false;
+    }
+    value = negative ? -x : x;
+    return true;
+  }
+
+  bool parse_type(const char *p, const char *end, int &type) {
+    static const char *names[3] = {"gain", "loss", "loh"};
+    size_t n = end - p;
+    for(int t = Gain; t <= LOH; ++t) {
+      if(strlen(names[t]) != n) continue;
+      size_t i = 0;
+      while(i < n && (p[i] | 0x20) == names[t][i]) ++i;
+      if(i == n) {
+        type = t;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Builds the sorted dictionary of all chunks and the remapping of
+  // each chunk's local ids into it.
+  template<typename Less>
+  void merge_names(
+      const std::vector<const std::vector<std::string>*> &local,
+      Less less,
+      std::vector<std::string> &names,
+      std::vector<std::vector<int>> &remap
+  ) {
+    names.clear();
+    for(const std::vector<std::string> *v : local) names.insert(names.end(), v->begin(), v->end());
+    std::sort(names.begin(), names.end(), less);
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    remap.resize(local.size());
+    for(size_t i = 0; i < local.size(); ++i) {
+      remap[i].clear();
+      for(const std::string &name : *local[i]) {
+        remap[i].push_back(std::lower_bound(names.begin(), names.end(), name, less) - names.begin());
+      }
+    }
+  }
+}
+
+SegmentParser::SegmentParser(const char *data, size_t size, bool header, ThreadPool &pool)
+  : pool(pool),
+    nrows(0)
+{
+  const char *begin = data;
+  const char *end = data + size;
+  size_t first_line = 1;
+  if(header && begin < end) {
+    begin = next_line(begin, end);
+    ++first_line;
+  }
+
+  // split at line boundaries
+  size_t nchunks = std::min<size_t>(4*pool.size(), (end - begin) / MIN_CHUNK_SIZE + 1);
+  size_t chunk_size = (end - begin) / nchunks + 1;
+  const char *p = begin;
+  while(p < end) {
+    chunks.emplace_back();
+    Chunk &chunk = chunks.back();
+    chunk.begin = p;
+    p = (size_t)(end - p) <= chunk_size ? end : next_line(p + chunk_size, end);
+    chunk.end = p;
+  }
+
+  // count lines and records of each chunk
+  pool.parallel_for(chunks.size(), [&](size_t i) {
+    Chunk &chunk = chunks[i];
+    chunk.lines = 0;
+    chunk.rows = 0;
+    for(const char *q = chunk.begin; q < chunk.end; ) {
+      const char *eol = line_end(q, chunk.end);
+      if(is_record(q, eol)) ++chunk.rows;
+      ++chunk.lines;
+      q = eol == chunk.end ? eol : eol + 1;
+    }
+  });
+
+  for(Chunk &chunk : chunks) {
+    chunk.first_line = first_line;
+    chunk.first_row = nrows;
+    first_line += chunk.lines;
+    nrows += chunk.rows;
+  }
+}
+
+void SegmentParser::parse_chunk(Chunk &chunk, int *patient, int *chr, int *start, int *end, int *type, int base) {
+  Dictionary patient_ids, chromosome_ids;
+  size_t row = chunk.first_row;
+  size_t line = chunk.first_line;
+
+  for(const char *p = chunk.begin; p < chunk.end; ++line) {
+    const char *eol = line_end(p, chunk.end);
+    const char *next = eol == chunk.end ? eol : eol + 1;
+    if(eol > p && eol[-1] == '\r') --eol;
+    if(!is_record(p, eol)) {
+      p = next;
+      continue;
+    }
+
+    // split first five fields
+    const char *fields[6];
+    size_t nfields = 0;
+    fields[nfields++] = p;
+    for(const char *q = p; q < eol && nfields < 6; ++q) {
+      if(*q == '\t') fields[nfields++] = q + 1;
+    }
+    if(nfields < 5) {
+      chunk.error_line = line;
+      chunk.error = "expected at least 5 columns";
+      return;
+    }
+    if(nfields == 5) fields[5] = eol + 1;
+
+    patient[row] = patient_ids.get(fields[0], fields[1] - fields[0] - 1);
+    chr[row] = chromosome_ids.get(fields[1], fields[2] - fields[1] - 1);
+    if(!parse_int(fields[2], fields[3] - 1, start[row]) || !parse_int(fields[3], fields[4] - 1, end[row])) {
+      chunk.error_line = line;
+      chunk.error = "invalid position";
+      return;
+    }
+    int t;
+    if(!parse_type(fields[4], fields[5] - 1, t)) {
+      chunk.error_line = line;
+      chunk.error = "invalid segment type '" + std::string(fields[4], fields[5] - 1) + "'";
+      return;
+    }
+    type[row] = base + t;
+
+    ++row;
+    p = next;
+  }
+
+  chunk.patients.swap(patient_ids.names);
+  chunk.chromosomes.swap(chromosome_ids.names);
+}
+
+void SegmentParser::parse(int *patient, int *chr, int *start, int *end, int *type, int base) {
+  pool.parallel_for(chunks.size(), [&](size_t i) {
+    parse_chunk(chunks[i], patient, chr, start, end, type, base);
+  });
+  if(pool.cancelled()) return;
+
+  for(const Chunk &chunk : chunks) {
+    if(!chunk.error.empty()) {
+      throw std::runtime_error("Line " + std::to_string(chunk.error_line) + ": " + chunk.error);
+    }
+  }
+
+  // replace local ids with indices into the merged dictionaries
+  std::vector<const std::vector<std::string>*> local_patients, local_chromosomes;
+  for(const Chunk &chunk : chunks) {
+    local_patients.push_back(&chunk.patients);
+    local_chromosomes.push_back(&chunk.chromosomes);
+  }
+  std::vector<std::vector<int>> patient_remap, chromosome_remap;
+  merge_names(local_patients, std::less<std::string>(), patient_names, patient_remap);
+  merge_names(local_chromosomes, natural_less, chromosome_names, chromosome_remap);
+
+  pool.parallel_for(chunks.size(), [&](size_t i) {
+    const Chunk &chunk = chunks[i];
+    for(size_t row = chunk.first_row; row < chunk.first_row + chunk.rows; ++row) {
+      patient[row] = base + patient_remap[i][patient[row]];
+      chr[row] = base + chromosome_remap[i][chr[row]];
+    }
+  });
+}
@@ -0,0 +1,52 @@
+#ifndef SEGMENT_PARSER_H
+#define SEGMENT_PARSER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "ThreadPool.h"
+
+// Parses tab-separated segment records (patient, chr, start, end, type)
+// from a buffer in parallel chunks. Further columns are ignored, as are
+// blank lines and lines starting with '#'.
+class SegmentParser {
+public:
+  SegmentParser(const char *data, size_t size, bool header, ThreadPool &pool);
+
+  size_t rows() const { return nrows; }
+
+  // Parses all records into the given columns of length rows(). Patients
+  // and chromosomes are dictionary encoded as base + index into patients()
+  // and chromosomes(). Types are encoded as base + VARIATION_TYPE.
+  // Throws std::runtime_error on malformed records.
+  void parse(int *patient, int *chr, int *start, int *end, int *type, int base);
+
+  // Names in sorted and natural order respectively.
+  const std::vector<std::string> &patients() const { return patient_names; }
+  const std::vector<std::string> &chromosomes() const { return chromosome_names; }
+
+private:
+  class Chunk {
+  public:
+    const char *begin;
+    const char *end;
+    size_t first_line;
+    size_t lines;
+    size_t first_row;
+    size_t rows;
+    std::vector<std::string> patients;
+    std::vector<std::string> chromosomes;
+    size_t error_line;
+    std::string error;
+  };
+
+  ThreadPool &pool;
+  size_t nrows;
+  std::vector<Chunk> chunks;
+  std::vector<std::string> patient_names;
+  std::vector<std::string> chromosome_names;
+
+  void parse_chunk(Chunk &chunk, int *patient, int *chr, int *start, int *end, int *type, int base);
+};
+
+#endif
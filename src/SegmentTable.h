@@ -0,0 +1,28 @@
+#ifndef SEGMENT_TABLE_H
+#define SEGMENT_TABLE_H
+
+#include <vector>
+#include <cstddef>
+#include "Segment.h"
+
+// Column view of a group's segments. Patient, position and type columns
+// are borrowed from the caller and must outlive the table; only the
+// chromosome ids are owned.
+class SegmentTable {
+public:
+  const int *patient;
+  const int *start;
+  const int *end;
+  const int *type;
+  std::vector<int> chr;
+
+  SegmentTable() : patient(nullptr), start(nullptr), end(nullptr), type(nullptr) {}
+
+  size_t size() const { return chr.size(); }
+
+  Segment operator[](size_t i) const {
+    return Segment(patient[i], chr[i], start[i], end[i], type[i]);
+  }
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include <vector>
+#include <algorithm>
+#include "StateArena.h"
+
+namespace {
+  const size_t NONE = (size_t)-1;
+}
+
+const size_t StateArena::CHECKPOINT_INTERVAL;
+
+StateArena::StateArena(int npatients1, int npatients2)
+  : view_checkpoints(nullptr),
+    view_offsets(nullptr),
+    view_flips(nullptr)
+{
+  init(npatients1, npatients2);
+  own_offsets.push_back(0);
+  last.assign(stride, 0);
+}
+
+StateArena::StateArena(
+  int npatients1, int npatients2,
+  const uint64_t *checkpoints, const uint64_t *offsets, const uint32_t *flips,
+  size_t nrows
+) : view_checkpoints(checkpoints),
+    view_offsets(offsets),
+    view_flips(flips)
+{
+  init(npatients1, npatients2);
+  this->nrows = nrows;
+}
+
+void StateArena::init(int npatients1, int npatients2) {
+  npatients[0] = npatients1;
+  npatients[1] = npatients2;
+  for(size_t group = 0; group < 2; ++group) {
+    nwords[group] = (npatients[group] + 63) / 64;
+  }
+  offset[0] = 0;
+  offset[1] = 3*nwords[0];
+  stride = 3*(nwords[0] + nwords[1]);
+  nrows = 0;
+}
+
+size_t StateArena::memory_usage() const {
+  return (own_checkpoints.capacity() + own_offsets.capacity() + last.capacity()) * sizeof(uint64_t)
+    + own_flips.capacity() * sizeof(uint32_t);
+}
+
+bool StateArena::is_patient(size_t bit) const {
+  size_t w = bit / 64;
+  if(w >= stride) return false;
+  size_t group = w < offset[1] ? 0 : 1;
+  size_t patient = (w - offset[group]) % nwords[group] * 64 + bit % 64;
+  return patient < (size_t)npatients[group];
+}
+
+bool StateArena::valid_row(const uint64_t *row) const {
+  for(size_t group = 0; group < 2; ++group) {
+    if(npatients[group] % 64 == 0) continue;
+    uint64_t padding = ~(uint64_t)0 << (npatients[group] % 64);
+    for(size_t type = 0; type < 3; ++type) {
+      if(row[word(group, type) + nwords[group] - 1] & padding) return false;
+    }
+  }
+  return true;
+}
+
+size_t StateArena::end_row() {
+  if(nrows % CHECKPOINT_INTERVAL == 0) own_checkpoints.insert(own_checkpoints.end(), last.begin(), last.end());
+  own_offsets.push_back(own_flips.size());
+  return nrows++;
+}
+
+size_t StateArena::push(const std::vector<uint64_t> &row) {
+  for(size_t w = 0; w < stride; ++w) {
+    uint64_t diff = row[w] ^ last[w];
+    while(diff != 0) {
+      own_flips.push_back(w*64 + __builtin_ctzll(diff));
+      diff &= diff - 1;
+    }
+    last[w] = row[w];
+  }
+  return end_row();
+}
+
+void StateArena::append(const StateArena &other) {
+  if(other.size() == 0) return;
+
+  // the first row is relative to an empty row, the others can be copied
+  const uint64_t *first = other.checkpoint(0);
+  push(std::vector<uint64_t>(first, first + stride));
+
+  const uint64_t *offsets = other.flip_offsets();
+  const uint32_t *flips = other.flips();
+  for(size_t i = 1; i < other.size(); ++i) {
+    for(uint64_t f = offsets[i]; f < offsets[i+1]; ++f) {
+      own_flips.push_back(flips[f]);
+      last[flips[f] / 64] ^= (uint64_t)1 << (flips[f] % 64);
+    }
+    end_row();
+  }
+}
+
+bool StateArena::test(size_t index, size_t group, size_t type, size_t patient) const {
+  size_t bit = (word(group, type) + patient / 64) * 64 + patient % 64;
+  size_t first = index / CHECKPOINT_INTERVAL * CHECKPOINT_INTERVAL;
+  bool value = (checkpoint(index / CHECKPOINT_INTERVAL)[bit / 64] >> (bit % 64)) & 1;
+
+  const uint64_t *offsets = flip_offsets();
+  const uint32_t *f = flips();
+  for(uint64_t i = offsets[first+1]; i < offsets[index+1]; ++i) {
+    if(f[i] == bit) value = !value;
+  }
+  return value;
+}
+
+StateReader::StateReader(const StateArena &arena)
+  : arena(&arena),
+    buffer(arena.row_size(), 0),
+    current(NONE)
+{}
+
+const uint64_t *StateReader::row(size_t index) {
+  size_t first = index / StateArena::CHECKPOINT_INTERVAL * StateArena::CHECKPOINT_INTERVAL;
+
+  // continue from the current row unless a checkpoint is closer
+  if(current == NONE || current > index || current < first) {
+    const uint64_t *checkpoint = arena->checkpoint(index / StateArena::CHECKPOINT_INTERVAL);
+    std::copy(checkpoint, checkpoint + buffer.size(), buffer.begin());
+    current = first;
+  }
+
+  const uint64_t *offsets = arena->flip_offsets();
+  const uint32_t *flips = arena->flips();
+  for(uint64_t i = offsets[current+1]; i < offsets[index+1]; ++i) {
+    buffer[flips[i] / 64] ^= (uint64_t)1 << (flips[i] % 64);
+  }
+  current = index;
+  return buffer.data();
+}
@@ -0,0 +1,129 @@
+#ifndef STATE_ARENA_H
+#define STATE_ARENA_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "defines.h"
+
+inline int popcount(uint64_t x) {
+  return __builtin_popcountll(x);
+}
+
+// Packed patient states for a sequence of regions.
+// Each row holds a word-aligned bitset per (group, type). Consecutive rows
+// only differ in the patients with events at the breakpoint between them,
+// so every row is stored as the list of bits flipped since the previous
+// row, and every CHECKPOINT_INTERVAL-th row is also stored in full.
+// Rows are read through a StateReader, which applies the flips of each row
+// when reading in order and starts from the preceding checkpoint otherwise.
+// An arena either owns its rows or is a read-only view of rows stored
+// elsewhere, e.g. in a memory-mapped index.
+class StateArena {
+public:
+  static const size_t CHECKPOINT_INTERVAL = 64;
+
+  StateArena(int npatients1, int npatients2);
+
+  // View of nrows rows with checkpoints, flip offsets and flips laid out
+  // as returned by checkpoint(), flip_offsets() and flips().
+  StateArena(
+    int npatients1, int npatients2,
+    const uint64_t *checkpoints, const uint64_t *offsets, const uint32_t *flips,
+    size_t nrows
+  );
+
+  size_t row_size() const { return stride; }
+  size_t size() const { return nrows; }
+  int patients(size_t group) const { return npatients[group]; }
+  size_t group_words(size_t group) const { return nwords[group]; }
+
+  // Offset of the bitset of a group and type within a row.
+  size_t word(size_t group, size_t type) const { return offset[group] + type*nwords[group]; }
+
+  size_t memory_usage() const;
+
+  // True if a bit of a row belongs to a patient rather than to the padding
+  // at the end of a bitset.
+  bool is_patient(size_t bit) const;
+
+  // True if no padding bit of a row is set.
+  bool valid_row(const uint64_t *row) const;
+
+  void set(std::vector<uint64_t> &row, size_t group, size_t type, size_t patient, bool value) const {
+    uint64_t &w = row[word(group, type) + patient / 64];
+    uint64_t mask = (uint64_t)1 << (patient % 64);
+    if(value) w |= mask;
+    else w &= ~mask;
+  }
+
+  bool test(const std::vector<uint64_t> &row, size_t group, size_t type, size_t patient) const {
+    return (row[word(group, type) + patient / 64] >> (patient % 64)) & 1;
+  }
+
+  // Appends a row and returns its index. Only arenas owning their rows
+  // can be appended to.
+  size_t push(const std::vector<uint64_t> &row);
+
+  // Appends the rows of another arena of the same patients.
+  void append(const StateArena &other);
+
+  bool test(size_t index, size_t group, size_t type, size_t patient) const;
+
+  // Storage of the rows: checkpoints() full rows, the offset of the first
+  // flip of each row plus one past the last, and the flipped bits.
+  size_t checkpoints() const { return (nrows + CHECKPOINT_INTERVAL - 1) / CHECKPOINT_INTERVAL; }
+  const uint64_t *checkpoint(size_t k) const {
+    return (view_checkpoints != nullptr ? view_checkpoints : own_checkpoints.data()) + k*stride;
+  }
+  const uint64_t *flip_offsets() const {
+    return view_offsets != nullptr ? view_offsets : own_offsets.data();
+  }
+  const uint32_t *flips() const {
+    return view_flips != nullptr ? view_flips : own_flips.data();
+  }
+  size_t nflips() const { return flip_offsets()[nrows]; }
+
+private:
+  int npatients[2];
+  size_t nwords[2];
+  size_t offset[2];
+  size_t stride;
+  size_t nrows;
+
+  std::vector<uint64_t> own_checkpoints;
+  std::vector<uint64_t> own_offsets;
+  std::vector<uint32_t> own_flips;
+  // last row pushed
+  std::vector<uint64_t> last;
+
+  const uint64_t *view_checkpoints;
+  const uint64_t *view_offsets;
+  const uint32_t *view_flips;
+
+  void init(int npatients1, int npatients2);
+
+  // Ends a row whose flips were appended and applied to last.
+  size_t end_row();
+};
+
+// Reconstructs rows of an arena. Reading rows in increasing order only
+// applies the flips in between, other reads start from a checkpoint.
+// Pointers returned are valid until the next read.
+class StateReader {
+public:
+  explicit StateReader(const StateArena &arena);
+
+  const uint64_t *row(size_t index);
+
+  const uint64_t *get(size_t index, size_t group, size_t type) {
+    return row(index) + arena->word(group, type);
+  }
+
+private:
+  const StateArena *arena;
+  std::vector<uint64_t> buffer;
+  size_t current;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include <chrono>
+#include "ThreadPool.h"
+
+namespace {
+  thread_local const ThreadPool *current_pool = nullptr;
+  thread_local size_t current_id = 0;
+}
+
+ThreadPool::ThreadPool(unsigned int nthreads)
+  : queued(0),
+    pending(0),
+    stop(false),
+    cancel_flag(false),
+    next_queue(0)
+{
+  if(nthreads < 1) nthreads = 1;
+  for(size_t i = 0; i < nthreads; ++i) queues.emplace_back(new Queue());
+  for(size_t i = 0; i < nthreads; ++i) workers.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  cancel();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  wake.notify_all();
+  for(std::thread &th : workers) th.join();
+}
+
+size_t ThreadPool::worker_id() const {
+  return current_pool == this ? current_id : workers.size();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  size_t id = worker_id();
+  if(id == workers.size()) id = next_queue++ % workers.size();
+
+  ++pending;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++queued;
+  }
+  {
+    std::lock_guard<std::mutex> lock(queues[id]->mutex);
+    queues[id]->tasks.push_back(std::move(task));
+  }
+  wake.notify_one();
+}
+
+bool ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while(pending > 0) {
+    done.wait_for(lock, std::chrono::milliseconds(100));
+    if(interrupt_check && !cancel_flag && pending > 0) {
+      lock.unlock();
+      if(interrupt_check()) cancel();
+      lock.lock();
+    }
+  }
+  if(error) {
+    std::exception_ptr e = error;
+    error = nullptr;
+    std::rethrow_exception(e);
+  }
+  return !cancel_flag;
+}
+
+bool ThreadPool::parallel_for(size_t n, const std::function<void(size_t)> &f) {
+  for(size_t i = 0; i < n; ++i) {
+    submit([&f, i]() { f(i); });
+  }
+  return wait();
+}
+
+bool ThreadPool::pop(size_t id, std::function<void()> &task) {
+  size_t n = queues.size();
+  for(size_t k = 0; k < n; ++k) {
+    size_t victim = (id + k) % n;
+    Queue &q = *queues[victim];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if(q.tasks.empty()) continue;
+    if(k == 0) {
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+    } else {
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+    --queued;
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::run(size_t id) {
+  current_pool = this;
+  current_id = id;
+
+  std::function<void()> task;
+  while(true) {
+    if(pop(id, task)) {
+      if(!cancel_flag) {
+        try {
+          task();
+        } catch(...) {
+          // keep the first exception for wait() and skip the remaining tasks
+          std::lock_guard<std::mutex> lock(mutex);
+          if(!error) error = std::current_exception();
+          cancel();
+        }
+      }
+      task = nullptr;
+      if(--pending == 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    wake.wait(lock, [this]() { return stop || queued > 0; });
+    if(stop && queued == 0) return;
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+// Persistent pool of worker threads shared by all parallel stages of a run.
+// Every worker owns a task deque. Workers pop their own tasks from the back
+// and steal from the front of other workers' deques when idle.
+//
+// Cancellation is cooperative: once cancel() is called, queued tasks are
+// discarded and running tasks may poll cancelled() to return early. A task
+// throwing an exception cancels the pool, and the first exception thrown
+// is rethrown by wait() on the calling thread.
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned int nthreads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool &operator=(const ThreadPool&) = delete;
+
+  unsigned int size() const { return workers.size(); }
+
+  // Index of the calling worker in [0, size()), or size() for other threads.
+  size_t worker_id() const;
+
+  void submit(std::function<void()> task);
+
+  // Blocks until all submitted tasks have finished or were discarded.
+  // Returns false if the pool was cancelled. Rethrows the first exception
+  // thrown by a task since the last wait. Must not be called from a worker.
+  bool wait();
+
+  // Runs f(i) for every i in [0, n) and waits for completion, see wait().
+  bool parallel_for(size_t n, const std::function<void(size_t)> &f);
+
+  void cancel() { cancel_flag = true; }
+  bool cancelled() const { return cancel_flag; }
+
+  // Called periodically by the thread blocked in wait(). The pool is
+  // cancelled once it returns true, e.g. on a user interrupt.
+  void set_interrupt_check(std::function<bool()> check) { interrupt_check = check; }
+
+private:
+  class Queue {
+  public:
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  std::atomic<size_t> queued;
+  std::atomic<size_t> pending;
+  std::atomic<bool> stop;
+  std::atomic<bool> cancel_flag;
+  std::atomic<size_t> next_queue;
+  std::function<bool()> interrupt_check;
+  // first exception thrown by a task, guarded by mutex
+  std::exception_ptr error;
+
+  bool pop(size_t id, std::function<void()> &task);
+  void run(size_t id);
+};
+
+#endif
@@ -0,0 +1,12 @@
+#include <vector>
+#include "batch_model.h"
+#include "Region.h"
+#include "CNVR.h"
+
+void batch_model(const Region &region, const std::vector<RegionModel> &models, std::vector<CNVR> &result) {
+  for(size_t query = 0; query < models.size(); ++query) {
+    size_t first = result.size();
+    models[query](region, result);
+    for(size_t i = first; i < result.size(); ++i) result[i].query = query;
+  }
+}
@@ -0,0 +1,13 @@
+#ifndef BATCH_MODEL_H
+#define BATCH_MODEL_H
+
+#include <vector>
+#include "Region.h"
+#include "CNVR.h"
+#include "get_regions.h"
+
+// Evaluates each model on the region and tags the results with the index
+// of the model that produced them.
+void batch_model(const Region &region, const std::vector<RegionModel> &models, std::vector<CNVR> &result);
+
+#endif
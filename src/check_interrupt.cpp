@@ -0,0 +1,10 @@
+#include <Rcpp.h>
+#include "check_interrupt.h"
+
+static void check_interrupt_fn(void*) {
+  R_CheckUserInterrupt();
+}
+
+bool check_interrupt() {
+  return R_ToplevelExec(check_interrupt_fn, NULL) == FALSE;
+}
@@ -0,0 +1,8 @@
+#ifndef CHECK_INTERRUPT_H
+#define CHECK_INTERRUPT_H
+
+// Checks for a pending user interrupt without leaving the current context.
+// Must be called from the main R thread.
+bool check_interrupt();
+
+#endif
@@ -1,24 +1,410 @@
 #include <Rcpp.h>
 #include <vector>
 #include <string>
-#include <unordered_set>
 #include <algorithm>
 #include <utility>
-#include <random>
+#include <memory>
+#include <deque>
+#include <map>
+#include <functional>
 #include <thread>
+#include <fstream>
+#include <chrono>
 #include <boost/format.hpp>
 #include "defines.h"
-#include "Segment.h"
+#include "SegmentTable.h"
+#include "ChromosomeIndex.h"
 #include "Region.h"
+#include "Contrast.h"
+#include "StateArena.h"
 #include "CNVR.h"
+#include "Cohort.h"
 #include "df_to_segments.h"
 #include "get_regions.h"
+#include "PermutationEngine.h"
 #include "statistical_model.h"
+#include "fisher_test.h"
 #include "query_model.h"
+#include "batch_model.h"
 #include "merge.h"
+#include "Predicate.h"
+#include "qvalues.h"
+#include "NullDistribution.h"
+#include "Fingerprint.h"
+#include "ThreadPool.h"
+#include "Profile.h"
+#include "Progress.h"
+#include "ResultBuilder.h"
+#include "check_interrupt.h"
 
 using namespace Rcpp;
 
+// Converts both data frames to segment tables split by chromosome.
+static void read_segments(
+    DataFrame df1, DataFrame df2,
+    SegmentTable &segments1, SegmentTable &segments2,
+    ChromosomeIndex &chromosome_index,
+    int npatients[2],
+    std::vector<ChromosomeSegments> &chromosomes
+) {
+  // view data frame columns as segment tables
+  df_to_segments(df1, chromosome_index, segments1);
+  df_to_segments(df2, chromosome_index, segments2);
+
+  // number chromosomes in natural order
+  std::vector<int> remap = chromosome_index.sort();
+  for(int &chr : segments1.chr) chr = remap[chr];
+  for(int &chr : segments2.chr) chr = remap[chr];
+
+  // get number of patients in each group
+  npatients[0] = npatients[1] = 0;
+  for(size_t i = 0; i < segments1.size(); ++i) npatients[0] = std::max(npatients[0], segments1.patient[i]+1);
+  for(size_t i = 0; i < segments2.size(); ++i) npatients[1] = std::max(npatients[1], segments2.patient[i]+1);
+
+  // split segments by chromosome
+  split_chromosomes(segments1, segments2, chromosome_index.size(), chromosomes);
+}
+
+// Compiles the predicates of one group for each query from a data frame
+// with one threshold per row and columns query, clause, comp, value, eq
+// and type. Thresholds of a clause are combined with AND, clauses with OR.
+static std::vector<Predicate> read_predicates(DataFrame df, size_t nqueries, int npatients) {
+  std::vector<int> query = as<std::vector<int>>(df["query"]);
+  std::vector<int> clause = as<std::vector<int>>(df["clause"]);
+  std::vector<int> comp = as<std::vector<int>>(df["comp"]);
+  std::vector<double> value = as<std::vector<double>>(df["value"]);
+  std::vector<int> eq = as<std::vector<int>>(df["eq"]);
+  std::vector<int> type = as<std::vector<int>>(df["type"]);
+
+  std::vector<std::vector<std::vector<Threshold>>> clauses(nqueries);
+  for(size_t i = 0; i < query.size(); ++i) {
+    std::vector<std::vector<Threshold>> &q = clauses[query[i]];
+    if((size_t)clause[i] >= q.size()) q.resize(clause[i] + 1);
+    q[clause[i]].emplace_back((COMPARISON)comp[i], value[i], (EQUALITY)eq[i], (VARIATION_TYPE)type[i]);
+  }
+
+  std::vector<Predicate> predicates;
+  for(const std::vector<std::vector<Threshold>> &q : clauses) predicates.emplace_back(q, npatients);
+  return predicates;
+}
+
+// Builds the model evaluated on each region. Each cutoff of the statistical
+// model, or each pair of predicates of the query model, is a separate query
+// and nqueries receives their number. For the query model, filter receives
+// the predicates as a block filter on region counts. fisher receives the
+// p-value table of the statistical model, built with tolerance fisher_tol,
+// and must outlive the returned model.
+// For the statistical model, bounds receives the counts that may produce
+// results of any query.
+static RegionModel make_model(
+    MODEL model,
+    const std::vector<double> &cutoff,
+    double fisher_tol,
+    DataFrame pred1,
+    DataFrame pred2,
+    int npatients1, int npatients2,
+    ThreadPool &pool,
+    std::unique_ptr<FisherTable> &fisher,
+    std::unique_ptr<HitBounds> &bounds,
+    RegionFilter &filter,
+    size_t &nqueries
+) {
+  std::vector<RegionModel> models;
+
+  if(model == MODEL_STAT) {
+    // p-values only depend on group sizes, which permutations preserve
+    fisher.reset(new FisherTable(npatients1, npatients2, fisher_tol, pool));
+    const FisherTable &table = *fisher;
+    bounds.reset(new HitBounds(statistical_bounds(table, *std::max_element(cutoff.begin(), cutoff.end()))));
+    for(double c : cutoff) {
+      models.push_back([&table, c](const Region &r, std::vector<CNVR> &out) {
+        statistical_model(r, table, c, out);
+      });
+    }
+  } else {
+    std::vector<int> query1 = as<std::vector<int>>(pred1["query"]);
+    std::vector<int> query2 = as<std::vector<int>>(pred2["query"]);
+    size_t npreds = 0;
+    for(int q : query1) npreds = std::max<size_t>(npreds, q + 1);
+    for(int q : query2) npreds = std::max<size_t>(npreds, q + 1);
+
+    std::vector<Predicate> preds1 = read_predicates(pred1, npreds, npatients1);
+    std::vector<Predicate> preds2 = read_predicates(pred2, npreds, npatients2);
+    for(size_t i = 0; i < npreds; ++i) {
+      const Predicate &p1 = preds1[i], &p2 = preds2[i];
+      models.push_back([p1, p2](const Region &r, std::vector<CNVR> &out) {
+        query_model(r, p1, p2, out);
+      });
+    }
+
+    filter = [preds1, preds2](const Counts *counts, size_t n, unsigned char *keep) {
+      unsigned char any[FILTER_BLOCK_SIZE];
+      unsigned char hit[FILTER_BLOCK_SIZE];
+      std::fill(any, any + n, 0);
+      for(size_t q = 0; q < preds1.size(); ++q) {
+        std::fill(hit, hit + n, 1);
+        query_filter(counts, n, preds1[q], preds2[q], hit);
+        for(size_t i = 0; i < n; ++i) any[i] |= hit[i];
+      }
+      for(size_t i = 0; i < n; ++i) keep[i] &= any[i];
+    };
+  }
+
+  nqueries = models.size();
+  if(models.size() == 1) return models[0];
+  return [models](const Region &r, std::vector<CNVR> &out) {
+    batch_model(r, models, out);
+  };
+}
+
+// Identifies the model and merge settings, which together with the
+// segments determine the null distribution of the q-values.
+static uint64_t model_fingerprint(
+    MODEL model,
+    const std::vector<double> &cutoff,
+    double fisher_tol,
+    DataFrame pred1,
+    DataFrame pred2,
+    bool merge,
+    unsigned int merge_threshold
+) {
+  Fingerprint fingerprint;
+  fingerprint.add((int)model);
+  if(model == MODEL_STAT) {
+    fingerprint.add(cutoff);
+    fingerprint.add(fisher_tol);
+  } else {
+    const char *columns[6] = {"query", "clause", "comp", "value", "eq", "type"};
+    for(DataFrame pred : {pred1, pred2}) {
+      for(const char *column : columns) fingerprint.add(as<std::vector<double>>(pred[column]));
+    }
+  }
+  fingerprint.add(merge);
+  fingerprint.add(merge ? merge_threshold : 0);
+  return fingerprint.value();
+}
+
+// Estimated bytes held by the chromosome ids and per-chromosome rows of
+// the segments. The other columns are borrowed from R.
+static size_t segments_memory(
+    const SegmentTable &segments1, const SegmentTable &segments2,
+    const std::vector<ChromosomeSegments> &chromosomes
+) {
+  size_t bytes = (segments1.chr.capacity() + segments2.chr.capacity()) * sizeof(int);
+  for(const ChromosomeSegments &c : chromosomes) {
+    bytes += sizeof(ChromosomeSegments) + (c.rows[0].capacity() + c.rows[1].capacity()) * sizeof(int);
+  }
+  return bytes;
+}
+
+// Estimated bytes held by the regions with hits and their results.
+static size_t hits_memory(const std::vector<std::deque<Region>> &hits, const std::vector<CNVR> &results) {
+  size_t bytes = results.capacity() * sizeof(CNVR);
+  for(const std::deque<Region> &h : hits) bytes += h.size() * sizeof(Region);
+  for(const CNVR &c : results) bytes += c.regions.capacity() * sizeof(const Region*);
+  return bytes;
+}
+
+// Records the regions, pruned regions and hits of each chromosome. events
+// holds the number of segment events of each chromosome, or is empty if
+// unknown.
+static void profile_chromosomes(
+    Profile &profile,
+    const std::vector<int> &chromosomes,
+    const std::vector<size_t> &events,
+    const std::vector<size_t> &nregions,
+    const std::vector<size_t> &npruned,
+    const std::vector<std::deque<Region>> &hits
+) {
+  profile.chromosomes = chromosomes;
+  profile.events = events;
+  profile.events.resize(chromosomes.size(), 0);
+  profile.regions = nregions;
+  profile.pruned = npruned;
+  profile.hits.clear();
+  for(const std::deque<Region> &h : hits) profile.hits.push_back(h.size());
+}
+
+// Converts a profile to R objects.
+static List profile_list(const Profile &profile, const ChromosomeIndex &chromosome_index) {
+  std::vector<std::string> chr;
+  std::vector<double> events, regions, pruned, hits;
+  for(size_t i = 0; i < profile.chromosomes.size(); ++i) {
+    chr.push_back(chromosome_index.name(profile.chromosomes[i]));
+    events.push_back(profile.events[i] > 0 ? (double)profile.events[i] : NA_REAL);
+    regions.push_back(profile.regions[i]);
+    pruned.push_back(profile.pruned[i]);
+    hits.push_back(profile.hits[i]);
+  }
+
+  double rate = profile.permutation_seconds > 0 ? profile.permutations / profile.permutation_seconds : NA_REAL;
+
+  std::vector<int> worker;
+  std::vector<double> worker_rate;
+  for(size_t i = 0; i < profile.worker_permutations.size(); ++i) {
+    worker.push_back(i + 1);
+    worker_rate.push_back(profile.worker_seconds[i] > 0 ? profile.worker_permutations[i] / profile.worker_seconds[i] : NA_REAL);
+  }
+
+  return List::create(
+    Named("stages") = DataFrame::create(
+      Named("stage") = profile.stages,
+      Named("seconds") = profile.seconds,
+      Named("stringsAsFactors") = false
+    ),
+    Named("chromosomes") = DataFrame::create(
+      Named("chr") = chr,
+      Named("events") = events,
+      Named("regions") = regions,
+      Named("pruned") = pruned,
+      Named("hits") = hits,
+      Named("stringsAsFactors") = false
+    ),
+    Named("results") = (double)profile.results,
+    Named("permutations") = List::create(
+      Named("repetitions") = (double)profile.permutations,
+      Named("seconds") = profile.permutation_seconds,
+      Named("threads") = profile.threads,
+      Named("rate") = rate,
+      Named("workers") = DataFrame::create(
+        Named("worker") = worker,
+        Named("repetitions") = std::vector<double>(profile.worker_permutations.begin(), profile.worker_permutations.end()),
+        Named("seconds") = profile.worker_seconds,
+        Named("rate") = worker_rate
+      )
+    ),
+    Named("memory") = DataFrame::create(
+      Named("component") = profile.components,
+      Named("bytes") = std::vector<double>(profile.bytes.begin(), profile.bytes.end()),
+      Named("stringsAsFactors") = false
+    ),
+    Named("peak_memory") = (double)profile.peak
+  );
+}
+
+// Converts results to R objects, leaving the profile empty.
+static List build_output(
+    const std::vector<CNVR> &results,
+    const ChromosomeIndex &chromosome_index,
+    int npatients1, int npatients2,
+    ThreadPool &pool,
+    unsigned int qvalues_rep_used,
+    bool full_freq,
+    bool full_state
+) {
+  ResultBuilder builder(results, chromosome_index, npatients1, npatients2, pool);
+
+  List out = List::create(
+    Named("regions") = builder.regions(),
+    Named("freq_range") = builder.freq_range(),
+    Named("state_mask") = builder.state_mask(),
+    Named("freq") = full_freq ? (SEXP)builder.full_freq() : R_NilValue,
+    Named("state") = full_state ? (SEXP)builder.full_state() : R_NilValue,
+    Named("qvalues_rep_used") = qvalues_rep_used,
+    Named("profile") = R_NilValue
+  );
+  if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
+  return out;
+}
+
+// Sorts results by query and p-value, ties in genomic order.
+static void sort_results(std::vector<CNVR> &results) {
+  std::stable_sort(results.begin(), results.end(), [](const CNVR &a, const CNVR &b) {
+    if(a.query != b.query) return a.query < b.query;
+    return a.pvalue < b.pvalue;
+  });
+}
+
+// Sorts and computes q-values of the merged results and converts them to
+// R objects. engine is only called when q-values are needed. If
+// qvalues_null is set, permutations stored in that file are reused and
+// new permutations are added to it. Stages are timed in profile, which is
+// returned if return_profile is set.
+static List make_output(
+    std::vector<CNVR> &results,
+    const RegionModel &model,
+    const HitBounds *bounds,
+    size_t nqueries,
+    const std::function<const PermutationEngine&()> &engine,
+    const ChromosomeIndex &chromosome_index,
+    int npatients1, int npatients2,
+    ThreadPool &pool,
+    bool qvalues,
+    unsigned int qvalues_rep,
+    unsigned int qvalues_stop,
+    double qvalues_threshold,
+    const std::string &qvalues_null,
+    uint64_t model_key,
+    bool merge,
+    unsigned int merge_threshold,
+    bool full_freq,
+    bool full_state,
+    Profile &profile,
+    bool return_profile,
+    Progress &progress
+) {
+  profile.start("sort");
+  sort_results(results);
+
+  unsigned int qvalues_rep_used = 0;
+
+  if(results.size() > 0 && qvalues) {
+    profile.start("engine");
+    Fingerprint fingerprint;
+    fingerprint.add(model_key);
+    engine().hash(fingerprint);
+
+    profile.start("qvalues");
+
+    NullDistribution null(nqueries, fingerprint.value());
+    if(!qvalues_null.empty() && std::ifstream(qvalues_null.c_str()).good()) {
+      null = NullDistribution(qvalues_null);
+      if(null.fingerprint() != fingerprint.value() || null.queries() != nqueries) {
+        stop("Null distribution in '%s' was computed for different segments, model or merge settings.", qvalues_null);
+      }
+    }
+    size_t nstored = null.size();
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    qvalues_rep_used = compute_qvalues(
+      engine(), model, bounds, merge, merge_threshold,
+      qvalues_rep, qvalues_stop, qvalues_threshold,
+      pool, progress, &profile, null, results
+    );
+    if(pool.cancelled()) {
+      progress.rethrow();
+      throw Rcpp::internal::InterruptedException();
+    }
+    profile.permutations = null.size() - nstored;
+    profile.permutation_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    profile.memory("null", null.memory_usage());
+
+    if(!qvalues_null.empty() && null.size() > nstored) null.save(qvalues_null);
+  }
+
+  // prepare output
+  profile.start("output");
+  List out = build_output(results, chromosome_index, npatients1, npatients2, pool, qvalues_rep_used, full_freq, full_state);
+
+  profile.stop();
+  profile.results = results.size();
+  profile.threads = pool.size();
+  if(return_profile) out["profile"] = profile_list(profile, chromosome_index);
+
+  return out;
+}
+
+// Seconds between calls of the progress callback.
+static const double PROGRESS_INTERVAL = 1.0;
+
+// Wraps an R function called with the repetitions done and their total.
+// Returns an empty callback if progress is NULL.
+static Progress::Callback progress_callback(SEXP progress) {
+  if(progress == R_NilValue) return Progress::Callback();
+  Function f(progress);
+  return [f](size_t done, size_t total) { f((double)done, (double)total); };
+}
+
 // [[Rcpp::export]]
 List convaqCpp(
     DataFrame df1,
@@ -26,186 +412,525 @@ List convaqCpp(
     unsigned int model_num,
     bool qvalues,
     unsigned int qvalues_rep,
+    unsigned int qvalues_stop,
+    double qvalues_threshold,
+    std::string qvalues_null,
     bool merge,
     unsigned int merge_threshold,
-    double cutoff,
-    unsigned int comp1, double value1, unsigned int eq1, unsigned int type1,
-    unsigned int comp2, double value2, unsigned int eq2, unsigned int type2,
-    unsigned int nthreads
+    std::vector<double> cutoff,
+    double fisher_tol,
+    bool full_freq,
+    bool full_state,
+    DataFrame pred1,
+    DataFrame pred2,
+    unsigned int nthreads,
+    bool profile,
+    SEXP progress
 ) {
   if(nthreads == 0) nthreads = std::thread::hardware_concurrency();
 
-  MODEL model = (MODEL)model_num;
+  // worker threads shared by all parallel stages
+  Progress run_progress(progress_callback(progress), PROGRESS_INTERVAL);
+  ThreadPool pool(nthreads);
+  pool.set_interrupt_check([&]() { return run_progress.report() || check_interrupt(); });
+
+  Profile run_profile;
+  run_profile.start("segments");
+  SegmentTable segments1, segments2;
+  ChromosomeIndex chromosome_index;
+  int npatients[2];
+  std::vector<ChromosomeSegments> chromosomes;
+  read_segments(df1, df2, segments1, segments2, chromosome_index, npatients, chromosomes);
+  run_profile.memory("segments", segments_memory(segments1, segments2, chromosomes));
 
-  std::vector<Segment> segments1, segments2;
+  run_profile.start("model");
+  std::unique_ptr<FisherTable> fisher;
+  std::unique_ptr<HitBounds> bounds;
+  RegionFilter filter;
+  size_t nqueries;
+  RegionModel region_model = make_model(
+    (MODEL)model_num, cutoff, fisher_tol,
+    pred1, pred2,
+    npatients[0], npatients[1], pool, fisher, bounds, filter, nqueries
+  );
+  if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
+  if(fisher) run_profile.memory("fisher", fisher->memory_usage());
 
-  // convert data frames to vector of Segment objects
-  df_to_segments(df1, segments1);
-  df_to_segments(df2, segments2);
+  // evaluate the model during the sweep, keeping only regions with hits
+  run_profile.start("regions");
+  std::vector<StateArena> states;
+  std::vector<std::deque<Region>> hits;
+  std::vector<size_t> nregions, npruned;
+  std::vector<CNVR> results;
+  stream_regions(
+    chromosomes, npatients[0], npatients[1], region_model, filter, bounds.get(), merge, merge_threshold, pool,
+    states, hits, nregions, npruned, results
+  );
+  if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
 
-  // get number of patients in each group
-  IntegerVector patients1 = df1["patient"];
-  IntegerVector patients2 = df2["patient"];
-  int npatients[2] = {
-    Rcpp::max(patients1)+1,
-    Rcpp::max(patients2)+1
+  std::vector<int> chr_ids;
+  std::vector<size_t> events;
+  size_t states_bytes = 0;
+  for(size_t c = 0; c < chromosomes.size(); ++c) {
+    chr_ids.push_back(chromosomes[c].chr);
+    events.push_back(2 * chromosomes[c].size());
+    states_bytes += states[c].memory_usage();
+  }
+  profile_chromosomes(run_profile, chr_ids, events, nregions, npruned, hits);
+  run_profile.memory("states", states_bytes);
+  run_profile.memory("hits", hits_memory(hits, results));
+
+  std::unique_ptr<PermutationEngine> engine;
+  auto get_engine = [&]() -> const PermutationEngine& {
+    if(!engine) {
+      engine.reset(new PermutationEngine(chromosomes, npatients[0], npatients[1], false));
+      run_profile.memory("engine", engine->memory_usage());
+    }
+    return *engine;
   };
 
-  // grab all chromosomes in data set
-  std::unordered_set<std::string> chromosomes;
-  StringVector chr1 = df1["chr"];
-  StringVector chr2 = df2["chr"];
-  for(size_t i = 0; i < chr1.length(); ++i) chromosomes.insert(std::string(chr1[i]));
-  for(size_t i = 0; i < chr2.length(); ++i) chromosomes.insert(std::string(chr2[i]));
+  return make_output(
+    results, region_model, bounds.get(), nqueries, get_engine, chromosome_index, npatients[0], npatients[1], pool,
+    qvalues, qvalues_rep, qvalues_stop, qvalues_threshold,
+    qvalues_null, model_fingerprint((MODEL)model_num, cutoff, fisher_tol, pred1, pred2, merge, merge_threshold),
+    merge, merge_threshold, full_freq, full_state,
+    run_profile, profile, run_progress
+  );
+}
 
-  std::vector<Region> regions;
-  get_regions(segments1, segments2, npatients[0], npatients[1], chromosomes, regions);
+// Returns the cohort of an external pointer created by cohortCpp or openIndexCpp.
+static Cohort &get_cohort(SEXP handle) {
+  XPtr<Cohort> ptr(handle);
+  if(ptr.get() == NULL) stop("Invalid cohort. Cohorts cannot be restored from saved sessions.");
+  return *ptr;
+}
+
+// [[Rcpp::export]]
+SEXP cohortCpp(
+    DataFrame df1,
+    DataFrame df2,
+    std::vector<std::string> labels1,
+    std::vector<std::string> labels2,
+    unsigned int nthreads
+) {
+  if(nthreads == 0) nthreads = std::thread::hardware_concurrency();
+
+  ThreadPool pool(nthreads);
+  pool.set_interrupt_check(check_interrupt);
+
+  SegmentTable segments1, segments2;
+  ChromosomeIndex chromosome_index;
+  int npatients[2];
+  std::vector<ChromosomeSegments> chromosomes;
+  read_segments(df1, df2, segments1, segments2, chromosome_index, npatients, chromosomes);
 
+  std::unique_ptr<Cohort> cohort(new Cohort(chromosomes, chromosome_index, npatients[0], npatients[1], labels1, labels2, pool));
+  if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
+
+  return XPtr<Cohort>(cohort.release(), true);
+}
+
+// [[Rcpp::export]]
+SEXP openIndexCpp(std::string path, bool verify) {
+  return XPtr<Cohort>(new Cohort(path, verify), true);
+}
+
+// [[Rcpp::export]]
+void saveCohortCpp(SEXP handle, std::string path) {
+  get_cohort(handle).save(path);
+}
+
+// [[Rcpp::export]]
+List cohortInfoCpp(SEXP handle) {
+  const Cohort &cohort = get_cohort(handle);
+
+  std::vector<std::string> chromosomes;
+  for(size_t i = 0; i < cohort.chromosomes().size(); ++i) chromosomes.push_back(cohort.chromosomes().name(i));
+
+  return List::create(
+    Named("patients1") = cohort.labels(0),
+    Named("patients2") = cohort.labels(1),
+    Named("chromosomes") = chromosomes,
+    Named("regions") = (double)cohort.size(),
+    Named("memory") = (double)cohort.memory_usage(),
+    Named("mapped") = (double)cohort.mapped_size()
+  );
+}
+
+// [[Rcpp::export]]
+List convaqCohortCpp(
+    SEXP handle,
+    unsigned int model_num,
+    bool qvalues,
+    unsigned int qvalues_rep,
+    unsigned int qvalues_stop,
+    double qvalues_threshold,
+    std::string qvalues_null,
+    bool merge,
+    unsigned int merge_threshold,
+    std::vector<double> cutoff,
+    double fisher_tol,
+    bool full_freq,
+    bool full_state,
+    DataFrame pred1,
+    DataFrame pred2,
+    unsigned int nthreads,
+    bool profile,
+    SEXP progress
+) {
+  const Cohort &cohort = get_cohort(handle);
+
+  if(nthreads == 0) nthreads = std::thread::hardware_concurrency();
+
+  Progress run_progress(progress_callback(progress), PROGRESS_INTERVAL);
+  ThreadPool pool(nthreads);
+  pool.set_interrupt_check([&]() { return run_progress.report() || check_interrupt(); });
+
+  Profile run_profile;
+  run_profile.memory("cohort", cohort.memory_usage());
+
+  run_profile.start("model");
+  std::unique_ptr<FisherTable> fisher;
+  std::unique_ptr<HitBounds> bounds;
+  RegionFilter filter;
+  size_t nqueries;
+  RegionModel region_model = make_model(
+    (MODEL)model_num, cutoff, fisher_tol,
+    pred1, pred2,
+    cohort.patients(0), cohort.patients(1), pool, fisher, bounds, filter, nqueries
+  );
+  if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
+  if(fisher) run_profile.memory("fisher", fisher->memory_usage());
+
+  run_profile.start("regions");
+  std::vector<std::deque<Region>> hits;
+  std::vector<size_t> npruned;
   std::vector<CNVR> results;
+  cohort.evaluate(region_model, filter, bounds.get(), merge, merge_threshold, pool, hits, npruned, results);
+  if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
 
-  if(model == MODEL_STAT) {
-    statistical_model(regions, npatients[0], npatients[1], cutoff, results);
-  } else {
-    query_model(
-      regions, npatients[0], npatients[1],
-      (COMPARISON)comp1, value1, (EQUALITY)eq1, (VARIATION_TYPE)type1,
-      (COMPARISON)comp2, value2, (EQUALITY)eq2, (VARIATION_TYPE)type2,
-      results
-    );
+  // segment events are not stored in cohorts
+  std::vector<int> chr_ids;
+  std::vector<size_t> nregions;
+  for(size_t c = 0; c < cohort.chromosomes().size(); ++c) {
+    chr_ids.push_back(c);
+    nregions.push_back(cohort.size(c));
   }
-  
-  if(results.size() > 0 && merge) merge_adjacent(results, merge_threshold);
-  
-  // sort by p-value
-  std::sort(results.begin(), results.end(), [](const CNVR &a, const CNVR &b) { return a.pvalue < b.pvalue; });
+  profile_chromosomes(run_profile, chr_ids, std::vector<size_t>(), nregions, npruned, hits);
+  run_profile.memory("hits", hits_memory(hits, results));
+
+  // the cohort accounts for its engine once built
+  auto get_engine = [&]() -> const PermutationEngine& {
+    const PermutationEngine &engine = cohort.engine();
+    run_profile.memory("cohort", cohort.memory_usage());
+    return engine;
+  };
+
+  return make_output(
+    results, region_model, bounds.get(), nqueries, get_engine,
+    cohort.chromosomes(), cohort.patients(0), cohort.patients(1), pool,
+    qvalues, qvalues_rep, qvalues_stop, qvalues_threshold,
+    qvalues_null, model_fingerprint((MODEL)model_num, cutoff, fisher_tol, pred1, pred2, merge, merge_threshold),
+    merge, merge_threshold, full_freq, full_state,
+    run_profile, profile, run_progress
+  );
+}
+
+// Evaluates several contrasts between groups of patients in one table of
+// segments. labels[i] is the group of patient i, and contrast c compares
+// the groups in groups1[c] to those in groups2[c] using a single cutoff or
+// pair of predicates. Each chromosome is swept once for all contrasts. For
+// q-values, labels are permuted among the patients each contrast compares,
+// and contrasts comparing the same groups share permutations. Returns
+// one output per contrast, laid out as a two-group analysis of its sides.
+// [[Rcpp::export]]
+List convaqContrastsCpp(
+    DataFrame df,
+    std::vector<int> labels,
+    List groups1,
+    List groups2,
+    unsigned int model_num,
+    bool qvalues,
+    unsigned int qvalues_rep,
+    unsigned int qvalues_stop,
+    double qvalues_threshold,
+    bool merge,
+    unsigned int merge_threshold,
+    double cutoff,
+    double fisher_tol,
+    bool full_freq,
+    bool full_state,
+    DataFrame pred1,
+    DataFrame pred2,
+    unsigned int nthreads
+) {
+  if(nthreads == 0) nthreads = std::thread::hardware_concurrency();
+
+  ThreadPool pool(nthreads);
+  pool.set_interrupt_check(check_interrupt);
+
+  // all patients form the first group
+  SegmentTable segments, empty;
+  ChromosomeIndex chromosome_index;
+  df_to_segments(df, chromosome_index, segments);
+  std::vector<int> remap = chromosome_index.sort();
+  for(int &chr : segments.chr) chr = remap[chr];
+  std::vector<ChromosomeSegments> chromosomes;
+  split_chromosomes(segments, empty, chromosome_index.size(), chromosomes);
+
+  std::vector<Contrast> contrasts;
+  for(R_xlen_t c = 0; c < groups1.size(); ++c) {
+    contrasts.emplace_back(as<std::vector<int>>(groups1[c]), as<std::vector<int>>(groups2[c]), labels);
+  }
+
+  // models only depend on the sizes of the two sides, so contrasts of
+  // equal sizes share their p-value table or compiled predicates
+  std::map<std::pair<int, int>, RegionModel> size_models;
+  std::vector<std::unique_ptr<FisherTable>> fisher;
+  std::vector<RegionModel> models;
+  for(const Contrast &c : contrasts) {
+    std::pair<int, int> sizes(c.patients(0), c.patients(1));
+    if(size_models.count(sizes) == 0) {
+      fisher.emplace_back();
+      std::unique_ptr<HitBounds> bounds;
+      RegionFilter filter;
+      size_t nqueries;
+      size_models[sizes] = make_model(
+        (MODEL)model_num, std::vector<double>(1, cutoff), fisher_tol,
+        pred1, pred2,
+        sizes.first, sizes.second, pool, fisher.back(), bounds, filter, nqueries
+      );
+      if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
+    }
+    models.push_back(size_models[sizes]);
+  }
+
+  std::vector<std::vector<StateArena>> states;
+  std::vector<std::vector<std::deque<Region>>> hits;
+  std::vector<size_t> nregions;
+  std::vector<CNVR> results;
+  stream_contrasts(chromosomes, labels, contrasts, models, merge, merge_threshold, pool, states, hits, nregions, results);
+  if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
+  sort_results(results);
+
+  // results of each contrast
+  std::vector<std::vector<CNVR>> slices(contrasts.size());
+  for(CNVR &r : results) slices[r.query].push_back(std::move(r));
+  std::vector<unsigned int> qvalues_rep_used(contrasts.size(), 0);
 
   if(results.size() > 0 && qvalues) {
-    std::vector<std::vector<int>> best(4);
+    results.clear();
+    PermutationEngine engine(chromosomes, labels.size(), 0, true);
 
-    for(size_t i = 0; i < 4; ++i) best[i].resize(qvalues_rep, 0);
+    // Labels are only permuted among the patients of the groups a contrast
+    // compares, as in a two-group analysis of its sides. Contrasts comparing
+    // the same groups, e.g. every one-vs-rest contrast, share permutations.
+    int ngroups = 0;
+    for(int g : labels) ngroups = std::max(ngroups, g + 1);
+    std::map<std::vector<bool>, std::vector<size_t>> partitions;
+    for(size_t c = 0; c < contrasts.size(); ++c) {
+      std::vector<bool> compared(ngroups);
+      for(int g = 0; g < ngroups; ++g) compared[g] = contrasts[c].compares(g);
+      partitions[compared].push_back(c);
+    }
 
-    std::vector<std::thread> threads;
-    for(size_t tid = 0; tid < nthreads; ++tid) {
-      threads.push_back(std::thread([&](size_t offset) {
-        // collect all group-patient pairs
-        std::vector<std::pair<int,int>> all_patients;
-        for(size_t group = 0; group < 2; ++group) {
-          for(int i = 0; i < npatients[group]; ++i) all_patients.emplace_back(group, i);
+    Progress progress;
+    for(const auto &partition : partitions) {
+      const std::vector<size_t> &members = partition.second;
+      std::vector<Contrast> part_contrasts;
+      std::vector<RegionModel> part_models;
+      std::vector<CNVR> part_results;
+      for(size_t k = 0; k < members.size(); ++k) {
+        part_contrasts.push_back(contrasts[members[k]]);
+        part_models.push_back(models[members[k]]);
+        for(CNVR &r : slices[members[k]]) {
+          part_results.push_back(std::move(r));
+          part_results.back().query = k;
         }
+      }
+      if(part_results.empty()) continue;
 
-        std::random_device rd;
-        std::minstd_rand rand(rd());
-
-        for(size_t rep = offset; rep < qvalues_rep; rep += nthreads) {
-          std::shuffle(all_patients.begin(), all_patients.end(), rand);
-
-          std::vector<std::set<int>> selected(2);
-          for(size_t i = 0; i < npatients[0]; ++i) {
-            selected[all_patients[i].first].insert(all_patients[i].second);
-          }
-
-          std::vector<Segment> q_segments1, q_segments2;
-          for(const Segment &s : segments1) {
-            if(selected[0].find(s.patient) != selected[0].end()) {
-              q_segments1.push_back(s);
-            } else {
-              q_segments2.push_back(s);
-            }
-          }
-          for(const Segment &s : segments2) {
-            if(selected[1].find(s.patient) != selected[1].end()) {
-              q_segments1.push_back(s);
-            } else {
-              q_segments2.push_back(s);
-            }
-          }
-
-          std::vector<Region> q_regions;
-          get_regions(q_segments1, q_segments2, npatients[0], npatients[1], chromosomes, q_regions);
-
-          std::vector<CNVR> q_results;
-          if(model == MODEL_STAT) {
-            statistical_model(q_regions, npatients[0], npatients[1], cutoff, q_results);
-          } else if(model == MODEL_QUERY) {
-            query_model(
-              q_regions, npatients[0], npatients[1],
-              (COMPARISON)comp1, value1, (EQUALITY)eq1, (VARIATION_TYPE)type1,
-              (COMPARISON)comp2, value2, (EQUALITY)eq2, (VARIATION_TYPE)type2,
-              q_results
-            );
-          }
-          
-          if(q_results.size() > 0 && merge) merge_adjacent(q_results, merge_threshold);
-
-          for(const CNVR &r : q_results) {
-            best[r.type][rep] = std::max(best[r.type][rep], r.length);
-          }
+      // compared patients, whose labels are shuffled
+      std::vector<size_t> patients;
+      std::vector<int> part_labels;
+      for(size_t i = 0; i < labels.size(); ++i) {
+        if(partition.first[labels[i]]) {
+          patients.push_back(i);
+          part_labels.push_back(labels[i]);
         }
-      }, tid));
-    }
+      }
 
-    for(std::thread &th : threads) th.join();
+      PermutedResults permuted = [&](const std::vector<std::vector<int>> &groups, size_t n, std::vector<std::vector<CNVR>> &out) {
+        std::vector<int> permuted_labels(labels);
+        out.resize(n);
+        for(size_t r = 0; r < n; ++r) {
+          for(size_t k = 0; k < patients.size(); ++k) permuted_labels[patients[k]] = groups[r][k];
+          engine.get_contrast_results(permuted_labels, part_contrasts, part_models, merge, merge_threshold, out[r]);
+        }
+      };
+      NullDistribution null(members.size(), 0);
+      unsigned int rep_used = compute_qvalues(
+        part_labels, permuted,
+        qvalues_rep, qvalues_stop, qvalues_threshold,
+        pool, progress, nullptr, null, part_results
+      );
+      if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
 
-    for(CNVR &r : results) {
-      int better = 0;
-      for(int l : best[r.type]) {
-        if(l >= r.length) ++better;
+      // results come back sorted by contrast and q-value
+      for(size_t k = 0; k < members.size(); ++k) {
+        slices[members[k]].clear();
+        qvalues_rep_used[members[k]] = rep_used;
       }
-      r.qvalue = (double)better / qvalues_rep;
+      for(const CNVR &r : part_results) slices[members[r.query]].push_back(r);
     }
-    
-    std::sort(results.begin(), results.end(), [](const CNVR &a, const CNVR &b) { return a.qvalue < b.qvalue; });
   }
 
-  // prepare output
-  std::vector<std::string> df_chr;
-  std::vector<int> df_start, df_end, df_length, df_type;
-  std::vector<double> df_pvalue, df_qvalue;
-
-  std::transform(results.begin(), results.end(), std::back_inserter(df_chr),    [](const CNVR &r){ return r.chr; });
-  std::transform(results.begin(), results.end(), std::back_inserter(df_start),  [](const CNVR &r){ return r.start; });
-  std::transform(results.begin(), results.end(), std::back_inserter(df_end),    [](const CNVR &r){ return r.end; });
-  std::transform(results.begin(), results.end(), std::back_inserter(df_length), [](const CNVR &r){ return r.length; });
-  std::transform(results.begin(), results.end(), std::back_inserter(df_type),   [](const CNVR &r){ return r.type; });
-  std::transform(results.begin(), results.end(), std::back_inserter(df_pvalue), [](const CNVR &r){ return r.pvalue; });
-  std::transform(results.begin(), results.end(), std::back_inserter(df_qvalue), [](const CNVR &r){ return r.qvalue; });
-  
-  DataFrame out_regions = DataFrame::create(
-    Named("chr") = df_chr,
-    Named("start") = df_start,
-    Named("end") = df_end,
-    Named("length") = df_length,
-    Named("type") = df_type,
-    Named("pvalue") = df_pvalue,
-    Named("qvalue") = df_qvalue
-  );
-  
-  // get within-group frequencies
-  List out_freq = List::create();
-  for(const CNVR &r : results) {
-    List region_freq = List::create();
-    for(size_t group = 0; group < 2; ++group) {
-      List group_freq = List::create();
-      for(size_t type = 0; type < 3; ++type) {
-        group_freq.push_back(r.get_freq(group, type));
-      }
-      region_freq.push_back(group_freq);
-    }
-    out_freq.push_back(region_freq);
+  List out(contrasts.size());
+  for(size_t c = 0; c < contrasts.size(); ++c) {
+    for(CNVR &r : slices[c]) r.query = 0;
+    out[c] = build_output(
+      slices[c], chromosome_index, contrasts[c].patients(0), contrasts[c].patients(1), pool,
+      qvalues_rep_used[c], full_freq, full_state
+    );
   }
-  
-  List out_state = List::create();
-  for(CNVR &r : results) {
-    List r_state = List::create();
-    for(size_t group = 0; group < 2; ++group) {
-      r_state.push_back(r.get_state(group));
+  return out;
+}
+
+// Times each stage of the analysis separately on the same segments. Merging
+// runs single threaded, all other stages use nthreads. pruned_model only
+// evaluates the statistical model on regions within the hit bounds. Only
+// the first query of pred1 and pred2 is used. Returns the wall time of each stage with
+// its number of input and output items.
+// [[Rcpp::export]]
+DataFrame benchmarkCpp(
+    DataFrame df1,
+    DataFrame df2,
+    double cutoff,
+    DataFrame pred1,
+    DataFrame pred2,
+    unsigned int qvalues_rep,
+    unsigned int merge_threshold,
+    unsigned int nthreads
+) {
+  typedef std::chrono::steady_clock clock;
+  if(nthreads == 0) nthreads = std::thread::hardware_concurrency();
+
+  ThreadPool pool(nthreads);
+  pool.set_interrupt_check(check_interrupt);
+
+  std::vector<std::string> stage;
+  std::vector<double> seconds, input, output;
+  clock::time_point start;
+  auto record = [&](const char *name, double in, double out) {
+    stage.push_back(name);
+    seconds.push_back(std::chrono::duration<double>(clock::now() - start).count());
+    input.push_back(in);
+    output.push_back(out);
+    if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
+    start = clock::now();
+  };
+
+  start = clock::now();
+  SegmentTable segments1, segments2;
+  ChromosomeIndex chromosome_index;
+  int npatients[2];
+  std::vector<ChromosomeSegments> chromosomes;
+  read_segments(df1, df2, segments1, segments2, chromosome_index, npatients, chromosomes);
+  double nsegments = segments1.size() + segments2.size();
+  record("df_to_segments", df1.nrows() + df2.nrows(), nsegments);
+
+  FisherTable fisher(npatients[0], npatients[1], 0, pool);
+  record("fisher_test", 1, (npatients[0]+1.0) * (npatients[1]+1.0));
+
+  HitBounds bounds = statistical_bounds(fisher, cutoff);
+  record("hit_bounds", 1, npatients[0] + npatients[1] + 1);
+
+  std::vector<StateArena> states;
+  std::vector<Region> regions;
+  get_regions(chromosomes, npatients[0], npatients[1], pool, states, regions);
+  record("get_regions", nsegments, regions.size());
+
+  std::vector<CNVR> results;
+  statistical_model(regions, fisher, cutoff, pool, results);
+  record("statistical_model", regions.size(), results.size());
+
+  // same model, skipping regions outside the bounds
+  std::vector<CNVR> bounded;
+  evaluate_regions(regions, [&](const Region &r, std::vector<CNVR> &out) {
+    if(bounds.possible(r.counts)) statistical_model(r, fisher, cutoff, out);
+  }, pool, bounded);
+  record("pruned_model", regions.size(), bounded.size());
+
+  std::vector<CNVR> merged(results);
+  AdjacentMerger(merge_threshold).add(merged, 0);
+  record("merge_adjacent", results.size(), merged.size());
+
+  std::vector<Predicate> preds1 = read_predicates(pred1, 1, npatients[0]);
+  std::vector<Predicate> preds2 = read_predicates(pred2, 1, npatients[1]);
+  std::vector<CNVR> matches;
+  const Predicate &p1 = preds1[0], &p2 = preds2[0];
+  evaluate_regions(regions, [&p1, &p2](const Region &r, std::vector<CNVR> &out) {
+    query_model(r, p1, p2, out);
+  }, pool, matches);
+  record("query_model", regions.size(), matches.size());
+
+  // release the sweep before timing the streaming path
+  std::vector<StateArena>().swap(states);
+  std::vector<Region>().swap(regions);
+  start = clock::now();
+
+  const FisherTable &table = fisher;
+  RegionModel model = [&table, cutoff](const Region &r, std::vector<CNVR> &out) {
+    statistical_model(r, table, cutoff, out);
+  };
+  std::vector<std::deque<Region>> hits;
+  results.clear();
+  std::vector<size_t> nregions, npruned;
+  stream_regions(
+    chromosomes, npatients[0], npatients[1], model, RegionFilter(), &bounds, true, merge_threshold, pool,
+    states, hits, nregions, npruned, results
+  );
+  record("stream_regions", nsegments, results.size());
+
+  PermutationEngine engine(chromosomes, npatients[0], npatients[1], false);
+  record("permutation_engine", nsegments, engine.memory_usage());
+
+  size_t nresults = results.size();
+  NullDistribution null(1, 0);
+  Progress progress;
+  unsigned int rep_used = results.empty() ? 0 : compute_qvalues(
+    engine, model, &bounds, true, merge_threshold, qvalues_rep, 0, -1,
+    pool, progress, nullptr, null, results
+  );
+  record("qvalues", nresults, rep_used);
+
+  return DataFrame::create(
+    Named("stage") = stage,
+    Named("seconds") = seconds,
+    Named("input") = input,
+    Named("output") = output,
+    Named("stringsAsFactors") = false
+  );
+}
+
+// P-values of every table with the given group sizes, as computed by
+// FisherTable (table) and by fisher_test() for each table (reference).
+// Rows are the positive patients of group 1, columns those of group 2.
+// [[Rcpp::export]]
+List fisherTableCpp(int npatients1, int npatients2, double tolerance, unsigned int nthreads) {
+  if(nthreads == 0) nthreads = std::thread::hardware_concurrency();
+  ThreadPool pool(nthreads);
+  FisherTable fisher(npatients1, npatients2, tolerance, pool);
+
+  NumericMatrix table(npatients1+1, npatients2+1), reference(npatients1+1, npatients2+1);
+  for(int pos1 = 0; pos1 <= npatients1; ++pos1) {
+    for(int pos2 = 0; pos2 <= npatients2; ++pos2) {
+      table(pos1, pos2) = fisher(pos1, pos2);
+      reference(pos1, pos2) = fisher_test(pos1, npatients1-pos1, pos2, npatients2-pos2);
     }
-    out_state.push_back(r_state);
   }
-  
   return List::create(
-    Named("regions") = out_regions,
-    Named("freq") = out_freq,
-    Named("state") = out_state
+    Named("table") = table,
+    Named("reference") = reference
   );
 }
@@ -1,18 +1,60 @@
 #include <Rcpp.h>
 #include <vector>
-#include "Segment.h"
+#include <unordered_map>
+#include "SegmentTable.h"
+#include "ChromosomeIndex.h"
 
 using namespace Rcpp;
 
-void df_to_segments(DataFrame df, std::vector<Segment> &segments) {
-  IntegerVector patient = df["patient"];
-  StringVector chr = df["chr"];
-  IntegerVector start = df["start"];
-  IntegerVector end = df["end"];
-  IntegerVector type = df["type"];
+static const int *integer_column(DataFrame df, const char *name) {
+  SEXP x = df[name];
+  if(TYPEOF(x) != INTSXP) stop("Column '%s' must be an integer vector.", name);
+  return INTEGER(x);
+}
+
+void df_to_segments(DataFrame df, ChromosomeIndex &chromosomes, SegmentTable &segments) {
+  segments.patient = integer_column(df, "patient");
+  segments.start = integer_column(df, "start");
+  segments.end = integer_column(df, "end");
+  segments.type = integer_column(df, "type");
+
+  SEXP chr = df["chr"];
+  size_t n = Rf_xlength(chr);
+  segments.chr.resize(n);
+
+  // factors only need their levels looked up
+  if(Rf_isFactor(chr)) {
+    SEXP levels = Rf_getAttrib(chr, R_LevelsSymbol);
+    std::vector<int> ids(Rf_xlength(levels));
+    for(size_t i = 0; i < ids.size(); ++i) {
+      ids[i] = chromosomes.insert(std::string(CHAR(STRING_ELT(levels, i))));
+    }
+    const int *codes = INTEGER(chr);
+    for(size_t i = 0; i < n; ++i) {
+      if(codes[i] == NA_INTEGER) stop("Column 'chr' contains missing values.");
+      segments.chr[i] = ids[codes[i]-1];
+    }
+    return;
+  }
+
+  if(TYPEOF(chr) != STRSXP) stop("Column 'chr' must be a character vector or factor.");
+
+  // R interns strings, so equal names share the same CHARSXP and names
+  // only need to be looked up once per distinct pointer.
+  std::unordered_map<SEXP, int> ids;
+  SEXP last = NULL;
+  int last_id = 0;
 
-  for(size_t i = 0; i < df.nrows(); ++i) {
-    std::string chr_str(chr[i]);
-    segments.emplace_back(patient[i], chr_str, start[i], end[i], type[i]);
+  for(size_t i = 0; i < n; ++i) {
+    SEXP name = STRING_ELT(chr, i);
+    if(name != last) {
+      auto it = ids.find(name);
+      if(it == ids.end()) {
+        it = ids.emplace(name, chromosomes.insert(std::string(CHAR(name)))).first;
+      }
+      last = name;
+      last_id = it->second;
+    }
+    segments.chr[i] = last_id;
   }
 }
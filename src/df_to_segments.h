@@ -2,9 +2,11 @@
 #define DF_TO_SEGMENTS_H
 
 #include <Rcpp.h>
-#include <vector>
-#include "Segment.h"
+#include "SegmentTable.h"
+#include "ChromosomeIndex.h"
 
-void df_to_segments(Rcpp::DataFrame df, std::vector<Segment> &segments);
+// Builds a column view of the data frame without copying its integer
+// columns. The data frame must outlive the table.
+void df_to_segments(Rcpp::DataFrame df, ChromosomeIndex &chromosomes, SegmentTable &segments);
 
 #endif
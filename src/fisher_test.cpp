@@ -22,6 +22,10 @@
 
 #include <boost/math/distributions/hypergeometric.hpp>
 #include <algorithm>
+#include <vector>
+#include <utility>
+#include <cmath>
+#include "fisher_test.h"
 
 double fisher_test(int a, int b, int c, int d) {
   unsigned N = a + b + c + d;
@@ -32,9 +36,73 @@ double fisher_test(int a, int b, int c, int d) {
   boost::math::hypergeometric_distribution<> hgd(r, n, N);
   double cutoff = pdf(hgd, c);
   double tmp_p = 0.0;
-  for(int k = min_for_k;k < max_for_k + 1;k++) {
+  for(unsigned k = min_for_k; k < max_for_k + 1; k++) {
     double p = pdf(hgd, k);
     if(p <= cutoff) tmp_p += p;
   }
   return tmp_p;
 }
+
+FisherTable::FisherTable(int npatients1, int npatients2, double tolerance, ThreadPool &pool)
+  : npatients1(npatients1),
+    npatients2(npatients2),
+    tolerance(tolerance),
+    table((size_t)(npatients1+1)*(npatients2+1), 1.0),
+    minimum(npatients1+npatients2+1, 1.0)
+{
+  int N = npatients1 + npatients2;
+
+  if(tolerance > 0) {
+    lfact.resize(N+1, 0.0);
+    for(int i = 2; i <= N; ++i) lfact[i] = lfact[i-1] + std::log((double)i);
+  }
+
+  size_t nchunks = 4*pool.size();
+  pool.parallel_for(nchunks, [&](size_t chunk) {
+    std::vector<std::pair<double,int>> pdfs;
+    for(int margin = chunk; margin <= N; margin += nchunks) {
+      fill_margin(margin, pdfs);
+    }
+  });
+}
+
+// Computes the p-values of all tables sharing the column margin pos1+pos2.
+// Every table in a margin has the same hypergeometric null distribution, so
+// each p-value is a prefix sum over the pdfs sorted in ascending order.
+// Without a tolerance, pdfs are computed by boost and only equal pdfs are
+// ties, as in the two-sided test of a single table. With a tolerance, pdfs
+// are computed from log factorials and, as in R's fisher.test, pdfs within
+// a relative error of tolerance count as ties.
+// The least likely table has the smallest p-value of the margin.
+void FisherTable::fill_margin(int margin, std::vector<std::pair<double,int>> &pdfs) {
+  int N = npatients1 + npatients2;
+  int r = margin;
+  int n = npatients2;
+  int max_for_k = std::min(r, n);
+  int min_for_k = std::max(0, r + n - N);
+
+  pdfs.clear();
+  if(tolerance > 0) {
+    double lnorm = lfact[N] - lfact[r] - lfact[N-r];
+    for(int k = min_for_k; k < max_for_k + 1; k++) {
+      double lp = lfact[n] - lfact[k] - lfact[n-k] + lfact[N-n] - lfact[r-k] - lfact[N-n-r+k] - lnorm;
+      pdfs.emplace_back(std::exp(lp), k);
+    }
+  } else {
+    boost::math::hypergeometric_distribution<> hgd(r, n, N);
+    for(int k = min_for_k; k < max_for_k + 1; k++) {
+      pdfs.emplace_back(pdf(hgd, k), k);
+    }
+  }
+  std::sort(pdfs.begin(), pdfs.end());
+
+  const double rel_err = 1 + tolerance;
+  double tmp_p = 0.0;
+  size_t j = 0;
+  for(size_t i = 0; i < pdfs.size(); ++i) {
+    while(j < pdfs.size() && pdfs[j].first <= pdfs[i].first * rel_err) tmp_p += pdfs[j++].first;
+    int k = pdfs[i].second;
+    table[(size_t)(margin-k)*(npatients2+1) + k] = tolerance > 0 ? std::min(tmp_p, 1.0) : tmp_p;
+  }
+  minimum[margin] = table[(size_t)(margin-pdfs[0].second)*(npatients2+1) + pdfs[0].second];
+}
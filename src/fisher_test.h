@@ -1,6 +1,48 @@
 #ifndef FISHER_TEST_H
 #define FISHER_TEST_H
 
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include "ThreadPool.h"
+
+// Two-sided Fisher's exact test p-values for every table with fixed group
+// sizes. Built once per run and shared read-only between threads.
+class FisherTable {
+public:
+  // With tolerance 0, tables are ties only if their probabilities are
+  // equal. A positive tolerance treats probabilities within that relative
+  // error as ties, as fisher.test does with 1e-7, and builds the table from
+  // log factorials, which is much faster for large groups.
+  FisherTable(int npatients1, int npatients2, double tolerance, ThreadPool &pool);
+
+  // Two-sided p-value of the table with pos1 of npatients1 and pos2 of
+  // npatients2 patients
+  double operator()(int pos1, int pos2) const {
+    return table[(size_t)pos1*(npatients2+1) + pos2];
+  }
+
+  // Smallest p-value of any table with pos1+pos2 == margin. No count of a
+  // margin can pass a cutoff below it.
+  double min_pvalue(int margin) const { return minimum[margin]; }
+
+  int patients(size_t group) const { return group == 0 ? npatients1 : npatients2; }
+
+  size_t memory_usage() const { return (table.capacity() + minimum.capacity() + lfact.capacity()) * sizeof(double); }
+
+private:
+  int npatients1;
+  int npatients2;
+  double tolerance;
+  std::vector<double> table;
+  std::vector<double> minimum;
+  std::vector<double> lfact;
+
+  void fill_margin(int margin, std::vector<std::pair<double,int>> &pdfs);
+};
+
+// Two-sided p-value of a single table, computed directly with exact ties.
+// Reference for FisherTable with tolerance 0.
 double fisher_test(int a, int b, int c, int d);
 
 #endif
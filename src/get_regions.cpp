@@ -1,73 +1,448 @@
 #include <vector>
-#include <unordered_set>
 #include <algorithm>
+#include <iterator>
+#include <deque>
 
 #include "get_regions.h"
+#include "defines.h"
 #include "Event.h"
-#include "Segment.h"
+#include "SegmentTable.h"
+#include "StateArena.h"
 
-void get_events(const std::vector<Segment> &segments, const std::string &chr, int group, std::vector<Event> &events) {
-  for(const Segment &s : segments) {
-    if(s.chr == chr) {
-      events.emplace_back(s.patient, s.chr, s.start, s.type, true, group);
-      events.emplace_back(s.patient, s.chr, s.end+1, s.type, false, group);
+void split_chromosomes(
+  const SegmentTable &segments1,
+  const SegmentTable &segments2,
+  size_t nchromosomes,
+  std::vector<ChromosomeSegments> &chromosomes
+) {
+  const SegmentTable *segments[2] = {&segments1, &segments2};
+
+  chromosomes.clear();
+  chromosomes.resize(nchromosomes);
+  for(size_t i = 0; i < nchromosomes; ++i) {
+    chromosomes[i].chr = i;
+    chromosomes[i].tables[0] = &segments1;
+    chromosomes[i].tables[1] = &segments2;
+  }
+
+  for(size_t group = 0; group < 2; ++group) {
+    const std::vector<int> &chr = segments[group]->chr;
+    for(size_t i = 0; i < chr.size(); ++i) {
+      chromosomes[chr[i]].rows[group].push_back(i);
     }
   }
-}
 
-void get_regions_chr(
-    const std::vector<Segment> &segments1, const std::vector<Segment> &segments2,
-    int npatients1, int npatients2,
-    const std::string &chr,
-    std::vector<Region> &regions
-) {
-  std::vector<Event> events;
+  chromosomes.erase(
+    std::remove_if(chromosomes.begin(), chromosomes.end(), [](const ChromosomeSegments &c) { return c.size() == 0; }),
+    chromosomes.end()
+  );
+}
 
-  get_events(segments1, chr, 0, events);
-  get_events(segments2, chr, 1, events);
+void get_events(const SegmentTable &segments, const std::vector<int> &rows, int group, std::vector<Event> &events) {
+  for(int i : rows) {
+    events.emplace_back(segments.patient[i], segments.chr[i], segments.start[i], segments.type[i], true, group);
+    events.emplace_back(segments.patient[i], segments.chr[i], segments.end[i]+1, segments.type[i], false, group);
+  }
+}
 
-  std::sort(events.begin(), events.end(), [](Event &a, Event &b) {
+void sort_events(std::vector<Event> &events) {
+  std::sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
     if(a.position == b.position && a.isStart != b.isStart) return b.isStart;
     return a.position < b.position;
   });
+}
 
-  std::vector<std::vector<std::vector<bool>>> states(2);
-  for(size_t i = 0; i < 2; ++i) {
-    states[i].resize(3);
-    for(size_t j = 0; j < 3; ++j) {
-      if(i == 0) states[i][j].resize(npatients1, false);
-      else states[i][j].resize(npatients2, false);
-    }
-  }
+// Sweeps the sorted events of a chromosome. breakpoint(first, last, state)
+// is called with the events at each breakpoint before they are applied.
+// flip(e, normal) is called whenever event e changes the state of its
+// patient, where normal is -1 if the patient gained its first variation,
+// 1 if it lost its last and 0 otherwise. emit(start, end, length, state)
+// is called for every region.
+template<typename Breakpoint, typename Flip, typename Emit>
+static void sweep_events(
+    const ChromosomeSegments &chromosome,
+    const StateArena &states,
+    Breakpoint breakpoint,
+    Flip flip,
+    Emit emit
+) {
+  std::vector<Event> events;
+  events.reserve(2*chromosome.size());
+
+  get_events(*chromosome.tables[0], chromosome.rows[0], 0, events);
+  get_events(*chromosome.tables[1], chromosome.rows[1], 1, events);
+
+  sort_events(events);
+
+  std::vector<uint64_t> state(states.row_size(), 0);
+
+  // number of active types per patient, updated only when a patient's
+  // state actually flips
+  std::vector<std::vector<int>> active(2);
+  active[0].resize(states.patients(0), 0);
+  active[1].resize(states.patients(1), 0);
 
   int currentPos = 0;
   int nextPos = events[0].position;
-  int i = 0;
+  size_t i = 0;
   while(i < events.size()) {
-    while(i < events.size() && events[i].position == nextPos) {
+    size_t last = i;
+    while(last < events.size() && events[last].position == nextPos) ++last;
+    breakpoint(events.data() + i, events.data() + last, state);
+
+    for(; i < last; ++i) {
       Event &e = events[i];
-      states[e.group][e.type][e.patient] = e.isStart;
-      ++i;
+      if(states.test(state, e.group, e.type, e.patient) != e.isStart) {
+        states.set(state, e.group, e.type, e.patient, e.isStart);
+        int &a = active[e.group][e.patient];
+        int normal = 0;
+        if(e.isStart) {
+          if(a++ == 0) normal = -1;
+        } else {
+          if(--a == 0) normal = 1;
+        }
+        flip(e, normal);
+      }
     }
     if(i >= events.size()) break;
 
     currentPos = nextPos;
     nextPos = events[i].position;
 
-    regions.emplace_back(chr, currentPos, nextPos-1, nextPos-currentPos+1, states);
+    emit(currentPos, nextPos-1, nextPos-currentPos+1, state);
   }
 }
 
+// Sweeps the events of both groups of a chromosome and calls
+// emit(start, end, length, counts, state) for every region.
+template<typename Emit>
+static void sweep_chr(
+    const ChromosomeSegments &chromosome,
+    int npatients1, int npatients2,
+    const StateArena &states,
+    Emit emit
+) {
+  // running per-type counts of each group
+  Counts counts = {{ {{0, 0, 0, npatients1}}, {{0, 0, 0, npatients2}} }};
+  sweep_events(chromosome, states,
+    [](const Event*, const Event*, const std::vector<uint64_t>&) {},
+    [&](const Event &e, int normal) {
+      counts[e.group][e.type] += e.isStart ? 1 : -1;
+      counts[e.group][Normal] += normal;
+    },
+    [&](int start, int end, int length, const std::vector<uint64_t> &state) {
+      emit(start, end, length, counts, state);
+    }
+  );
+}
+
+void get_regions_chr(
+    const ChromosomeSegments &chromosome,
+    int npatients1, int npatients2,
+    StateArena &states,
+    std::vector<Region> &regions
+) {
+  int chr = chromosome.chr;
+  sweep_chr(chromosome, npatients1, npatients2, states,
+    [&](int start, int end, int length, const Counts &counts, const std::vector<uint64_t> &state) {
+      size_t index = states.push(state);
+      regions.emplace_back(chr, start, end, length, counts, &states, index);
+    }
+  );
+}
+
+size_t stream_regions_chr(
+    const ChromosomeSegments &chromosome,
+    int npatients1, int npatients2,
+    const RegionModel &model,
+    const RegionFilter &filter,
+    const HitBounds *bounds,
+    bool merge,
+    unsigned int merge_threshold,
+    StateArena &states,
+    std::deque<Region> &hits,
+    size_t &pruned,
+    std::vector<CNVR> &results
+) {
+  int chr = chromosome.chr;
+  size_t nregions = 0;
+  pruned = 0;
+  AdjacentMerger merger(merge_threshold);
+
+  auto evaluate = [&](Region &region, const std::vector<uint64_t> &state) {
+    size_t first = results.size();
+    model(region, results);
+    if(results.size() == first) return;
+
+    // keep the region and its patient states only when it is a hit
+    region.states = &states;
+    region.index = states.push(state);
+    hits.push_back(region);
+    for(size_t i = first; i < results.size(); ++i) {
+      results[i].regions[0] = &hits.back();
+    }
+    if(merge) merger.add(results, first);
+  };
+
+  // with a filter, regions are held back with a copy of their states until
+  // a block is full, and the counts of the block are screened at once
+  std::vector<Region> block;
+  std::vector<Counts> block_counts;
+  std::vector<std::vector<uint64_t>> block_states(filter ? FILTER_BLOCK_SIZE : 0);
+  unsigned char keep[FILTER_BLOCK_SIZE];
+  auto flush = [&]() {
+    size_t n = block.size();
+    std::fill(keep, keep + n, 1);
+    filter(block_counts.data(), n, keep);
+    for(size_t i = 0; i < n; ++i) {
+      if(keep[i]) evaluate(block[i], block_states[i]);
+      else ++pruned;
+    }
+    block.clear();
+    block_counts.clear();
+  };
+
+  sweep_chr(chromosome, npatients1, npatients2, states,
+    [&](int start, int end, int length, const Counts &counts, const std::vector<uint64_t> &state) {
+      ++nregions;
+      if(bounds && !bounds->possible(counts)) {
+        ++pruned;
+        return;
+      }
+      Region region(chr, start, end, length, counts, nullptr, 0);
+      if(!filter) {
+        evaluate(region, state);
+        return;
+      }
+      block_states[block.size()] = state;
+      block.push_back(region);
+      block_counts.push_back(counts);
+      if(block.size() == FILTER_BLOCK_SIZE) flush();
+    }
+  );
+  if(!block.empty()) flush();
+  return nregions;
+}
+
 void get_regions(
-  const std::vector<Segment> &segments1,
-  const std::vector<Segment> &segments2,
+  const std::vector<ChromosomeSegments> &chromosomes,
   int npatients1,
   int npatients2,
-  const std::unordered_set<std::string> &chromosomes,
+  ThreadPool &pool,
+  std::vector<StateArena> &states,
   std::vector<Region> &regions
 ) {
+  size_t nchr = chromosomes.size();
+
+  states.clear();
+  states.resize(nchr, StateArena(npatients1, npatients2));
+  std::vector<std::vector<Region>> chr_regions(nchr);
+
+  // submit chromosomes largest first to balance workers
+  std::vector<size_t> order(nchr);
+  for(size_t i = 0; i < nchr; ++i) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return chromosomes[a].size() > chromosomes[b].size();
+  });
+
+  pool.parallel_for(nchr, [&](size_t i) {
+    size_t c = order[i];
+    get_regions_chr(chromosomes[c], npatients1, npatients2, states[c], chr_regions[c]);
+  });
+
+  size_t total = 0;
+  for(const std::vector<Region> &r : chr_regions) total += r.size();
+
   regions.clear();
-  for(const std::string &chr : chromosomes) {
-    get_regions_chr(segments1, segments2, npatients1, npatients2, chr, regions);
+  regions.reserve(total);
+  for(std::vector<Region> &r : chr_regions) {
+    std::move(r.begin(), r.end(), std::back_inserter(regions));
+  }
+}
+
+void evaluate_regions(
+  const std::vector<Region> &regions,
+  const RegionModel &model,
+  ThreadPool &pool,
+  std::vector<CNVR> &results
+) {
+  size_t nchunks = std::min<size_t>(
+    4*pool.size(),
+    (regions.size() + EVALUATE_CHUNK_SIZE - 1) / EVALUATE_CHUNK_SIZE
+  );
+  std::vector<std::vector<CNVR>> chunk_results(nchunks);
+
+  pool.parallel_for(nchunks, [&](size_t k) {
+    size_t begin = regions.size() * k / nchunks;
+    size_t end = regions.size() * (k+1) / nchunks;
+    for(size_t i = begin; i < end; ++i) {
+      model(regions[i], chunk_results[k]);
+    }
+  });
+
+  size_t total = results.size();
+  for(const std::vector<CNVR> &r : chunk_results) total += r.size();
+  results.reserve(total);
+  for(std::vector<CNVR> &r : chunk_results) {
+    std::move(r.begin(), r.end(), std::back_inserter(results));
+  }
+}
+
+void stream_regions(
+  const std::vector<ChromosomeSegments> &chromosomes,
+  int npatients1,
+  int npatients2,
+  const RegionModel &model,
+  const RegionFilter &filter,
+  const HitBounds *bounds,
+  bool merge,
+  unsigned int merge_threshold,
+  ThreadPool &pool,
+  std::vector<StateArena> &states,
+  std::vector<std::deque<Region>> &hits,
+  std::vector<size_t> &nregions,
+  std::vector<size_t> &npruned,
+  std::vector<CNVR> &results
+) {
+  size_t nchr = chromosomes.size();
+
+  states.clear();
+  states.resize(nchr, StateArena(npatients1, npatients2));
+  hits.clear();
+  hits.resize(nchr);
+  nregions.assign(nchr, 0);
+  npruned.assign(nchr, 0);
+  std::vector<std::vector<CNVR>> chr_results(nchr);
+
+  // submit chromosomes largest first to balance workers
+  std::vector<size_t> order(nchr);
+  for(size_t i = 0; i < nchr; ++i) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return chromosomes[a].size() > chromosomes[b].size();
+  });
+
+  pool.parallel_for(nchr, [&](size_t i) {
+    size_t c = order[i];
+    nregions[c] = stream_regions_chr(
+      chromosomes[c], npatients1, npatients2, model, filter, bounds, merge, merge_threshold,
+      states[c], hits[c], npruned[c], chr_results[c]
+    );
+  });
+
+  results.clear();
+  for(std::vector<CNVR> &r : chr_results) {
+    std::move(r.begin(), r.end(), std::back_inserter(results));
+  }
+}
+
+// Number of patients in each group.
+static std::vector<int> group_sizes(const std::vector<int> &labels) {
+  std::vector<int> sizes;
+  for(int g : labels) {
+    if((size_t)g >= sizes.size()) sizes.resize(g + 1, 0);
+    ++sizes[g];
+  }
+  return sizes;
+}
+
+size_t stream_contrasts_chr(
+    const ChromosomeSegments &chromosome,
+    const std::vector<int> &labels,
+    const std::vector<Contrast> &contrasts,
+    const std::vector<RegionModel> &models,
+    bool merge,
+    unsigned int merge_threshold,
+    std::vector<StateArena> &states,
+    std::vector<std::deque<Region>> &hits,
+    std::vector<CNVR> &results
+) {
+  int chr = chromosome.chr;
+  size_t nregions = 0;
+  AdjacentMerger merger(merge_threshold);
+
+  // running per-type counts of each group
+  std::vector<int> sizes = group_sizes(labels);
+  GroupCounts counts(sizes.size());
+  for(size_t g = 0; g < sizes.size(); ++g) counts[g] = {{0, 0, 0, sizes[g]}};
+
+  StateArena all(labels.size(), 0);
+  ContrastSweep sweep(contrasts, labels);
+  std::vector<uint64_t> row;
+  sweep_events(chromosome, all,
+    [&](const Event *first_event, const Event *last_event, const std::vector<uint64_t> &state) {
+      for(const Event *e = first_event; e != last_event; ++e) sweep.touch(e->patient);
+
+      // evaluate the regions ending here, whose patients are still in state
+      int position = first_event->position;
+      size_t first = results.size();
+      sweep.end([&](size_t c, int start, const Counts &region_counts) {
+        ++nregions;
+        Region region(chr, start, position-1, position-start+1, region_counts, nullptr, 0);
+        size_t from = results.size();
+        models[c](region, results);
+        if(results.size() == from) return;
+
+        // keep the region and the states of the contrast's patients
+        contrasts[c].convert_row(all, state, states[c], row);
+        region.states = &states[c];
+        region.index = states[c].push(row);
+        hits[c].push_back(region);
+        for(size_t i = from; i < results.size(); ++i) {
+          results[i].query = c;
+          results[i].regions[0] = &hits[c].back();
+        }
+      });
+      if(merge) merger.add(results, first);
+    },
+    [&](const Event &e, int normal) {
+      std::array<int, 4> &c = counts[labels[e.patient]];
+      c[e.type] += e.isStart ? 1 : -1;
+      c[Normal] += normal;
+    },
+    [&](int start, int, int, const std::vector<uint64_t>&) {
+      sweep.begin(start, counts);
+    }
+  );
+  return nregions;
+}
+
+void stream_contrasts(
+  const std::vector<ChromosomeSegments> &chromosomes,
+  const std::vector<int> &labels,
+  const std::vector<Contrast> &contrasts,
+  const std::vector<RegionModel> &models,
+  bool merge,
+  unsigned int merge_threshold,
+  ThreadPool &pool,
+  std::vector<std::vector<StateArena>> &states,
+  std::vector<std::vector<std::deque<Region>>> &hits,
+  std::vector<size_t> &nregions,
+  std::vector<CNVR> &results
+) {
+  size_t nchr = chromosomes.size();
+
+  std::vector<StateArena> contrast_states;
+  for(const Contrast &c : contrasts) contrast_states.emplace_back(c.patients(0), c.patients(1));
+  states.assign(nchr, contrast_states);
+  hits.clear();
+  hits.resize(nchr, std::vector<std::deque<Region>>(contrasts.size()));
+  nregions.assign(nchr, 0);
+  std::vector<std::vector<CNVR>> chr_results(nchr);
+
+  // submit chromosomes largest first to balance workers
+  std::vector<size_t> order(nchr);
+  for(size_t i = 0; i < nchr; ++i) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return chromosomes[a].size() > chromosomes[b].size();
+  });
+
+  pool.parallel_for(nchr, [&](size_t i) {
+    size_t c = order[i];
+    nregions[c] = stream_contrasts_chr(chromosomes[c], labels, contrasts, models, merge, merge_threshold, states[c], hits[c], chr_results[c]);
+  });
+
+  results.clear();
+  for(std::vector<CNVR> &r : chr_results) {
+    std::move(r.begin(), r.end(), std::back_inserter(results));
   }
 }
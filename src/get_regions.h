@@ -1,29 +1,162 @@
 #ifndef GET_REGIONS_H
 #define GET_REGIONS_H
 
-#include <string>
 #include <vector>
-#include <unordered_set>
-#include "Segment.h"
+#include <deque>
+#include <functional>
+#include "SegmentTable.h"
 #include "Region.h"
+#include "CNVR.h"
+#include "StateArena.h"
 #include "Event.h"
+#include "ThreadPool.h"
+#include "merge.h"
+#include "Contrast.h"
+#include "HitBounds.h"
 
-void get_events(const std::vector<Segment> &segments, const std::string &chr, int group, std::vector<Event> &events);
+// Segments of both groups located on a single chromosome,
+// given as row indices into each group's table.
+class ChromosomeSegments {
+public:
+  int chr;
+  const SegmentTable *tables[2];
+  std::vector<int> rows[2];
+
+  size_t size() const { return rows[0].size() + rows[1].size(); }
+};
+
+// Partitions segments by chromosome id in a single pass.
+// Chromosomes are returned in id order.
+void split_chromosomes(
+  const SegmentTable &segments1,
+  const SegmentTable &segments2,
+  size_t nchromosomes,
+  std::vector<ChromosomeSegments> &chromosomes
+);
+
+void get_events(const SegmentTable &segments, const std::vector<int> &rows, int group, std::vector<Event> &events);
+
+// Sorts events by position. Segment ends come before starts at the same position.
+void sort_events(std::vector<Event> &events);
 
 void get_regions_chr(
-    const std::vector<Segment> &segments1, const std::vector<Segment> &segments2,
+    const ChromosomeSegments &chromosome,
     int npatients1, int npatients2,
-    const std::string &chr,
+    StateArena &states,
     std::vector<Region> &regions
 );
 
+// Evaluates a model on a single region, appending a CNVR for each hit.
+typedef std::function<void(const Region &region, std::vector<CNVR> &result)> RegionModel;
+
+// Screens the counts of a block of at most FILTER_BLOCK_SIZE consecutive
+// regions, clearing keep[i] for each region a model produces no hit for.
+typedef std::function<void(const Counts *counts, size_t n, unsigned char *keep)> RegionFilter;
+
+const size_t FILTER_BLOCK_SIZE = 1024;
+
+// Smallest number of consecutive regions evaluated as a single task, a
+// multiple of FILTER_BLOCK_SIZE.
+const size_t EVALUATE_CHUNK_SIZE = 4*FILTER_BLOCK_SIZE;
+
+// Evaluates the model on each region, appending to results. The regions
+// are split into chunks of consecutive regions evaluated as separate tasks
+// into buffers of their own, which are appended in order, so results are
+// the same as evaluating the regions in order for any number of threads.
+void evaluate_regions(
+  const std::vector<Region> &regions,
+  const RegionModel &model,
+  ThreadPool &pool,
+  std::vector<CNVR> &results
+);
+
+// Evaluates the model on each region as the sweep emits it. Only regions
+// producing a hit are kept, together with their patient states, in hits.
+// With merge set, adjacent hits are merged as they are found. If bounds is
+// set, regions whose counts lie outside them are skipped, and if filter is
+// set, regions are screened by it in blocks of FILTER_BLOCK_SIZE. Skipped
+// regions are counted in pruned without evaluating the model. Returns the
+// number of regions swept.
+size_t stream_regions_chr(
+    const ChromosomeSegments &chromosome,
+    int npatients1, int npatients2,
+    const RegionModel &model,
+    const RegionFilter &filter,
+    const HitBounds *bounds,
+    bool merge,
+    unsigned int merge_threshold,
+    StateArena &states,
+    std::deque<Region> &hits,
+    size_t &pruned,
+    std::vector<CNVR> &results
+);
+
+// Sweeps each chromosome as a separate task. states receives one arena per
+// chromosome and must outlive the regions. Regions are ordered by chromosome.
 void get_regions(
-  const std::vector<Segment> &segments1,
-  const std::vector<Segment> &segments2,
+  const std::vector<ChromosomeSegments> &chromosomes,
   int npatients1,
   int npatients2,
-  const std::unordered_set<std::string> &chromosomes,
+  ThreadPool &pool,
+  std::vector<StateArena> &states,
   std::vector<Region> &regions
 );
 
+// Streaming counterpart of get_regions. states and hits receive one entry
+// per chromosome and must outlive the results, nregions and npruned receive
+// the number of regions swept and pruned on each chromosome. Results are
+// ordered by chromosome and position.
+void stream_regions(
+  const std::vector<ChromosomeSegments> &chromosomes,
+  int npatients1,
+  int npatients2,
+  const RegionModel &model,
+  const RegionFilter &filter,
+  const HitBounds *bounds,
+  bool merge,
+  unsigned int merge_threshold,
+  ThreadPool &pool,
+  std::vector<StateArena> &states,
+  std::vector<std::deque<Region>> &hits,
+  std::vector<size_t> &nregions,
+  std::vector<size_t> &npruned,
+  std::vector<CNVR> &results
+);
+
+// Multi-group counterpart of stream_regions_chr. The chromosome holds the
+// segments of all patients as its first group and labels[i] is the group
+// of patient i. The events of all patients are swept once, and each region
+// of contrast c, bounded by the breakpoints of its patients, is evaluated
+// by models[c] on the counts of its sides, tagging results with query c.
+// Regions with hits for contrast c are kept in hits[c] with their states
+// in states[c], which must be laid out for the two sides of the contrast.
+// Returns the number of regions evaluated over all contrasts.
+size_t stream_contrasts_chr(
+    const ChromosomeSegments &chromosome,
+    const std::vector<int> &labels,
+    const std::vector<Contrast> &contrasts,
+    const std::vector<RegionModel> &models,
+    bool merge,
+    unsigned int merge_threshold,
+    std::vector<StateArena> &states,
+    std::vector<std::deque<Region>> &hits,
+    std::vector<CNVR> &results
+);
+
+// Multi-group counterpart of stream_regions. states and hits receive one
+// entry per chromosome and contrast.
+void stream_contrasts(
+  const std::vector<ChromosomeSegments> &chromosomes,
+  const std::vector<int> &labels,
+  const std::vector<Contrast> &contrasts,
+  const std::vector<RegionModel> &models,
+  bool merge,
+  unsigned int merge_threshold,
+  ThreadPool &pool,
+  std::vector<std::vector<StateArena>> &states,
+  std::vector<std::vector<std::deque<Region>>> &hits,
+  std::vector<size_t> &nregions,
+  std::vector<CNVR> &results
+);
+
 #endif
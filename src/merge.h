@@ -2,8 +2,26 @@
 #define MERGE_H
 
 #include <vector>
+#include <cstddef>
 #include "CNVR.h"
 
-void merge_adjacent(std::vector<CNVR> &regions, unsigned int threshold);
+// Merges results of the same query and type into the previous one when
+// they are at most threshold base pairs apart. Results are merged online
+// as the sweep emits them, so they must be added in position order within
+// each chromosome.
+class AdjacentMerger {
+public:
+  explicit AdjacentMerger(unsigned int threshold) : threshold(threshold) {}
+
+  // Merges each of results[first..] into an earlier adjacent result or
+  // moves it down behind the results kept so far, then shrinks results.
+  // Earlier results must not have been reordered since they were added.
+  void add(std::vector<CNVR> &results, size_t first);
+
+private:
+  unsigned int threshold;
+  // index of the last result of each query and type
+  std::vector<size_t> last;
+};
 
 #endif
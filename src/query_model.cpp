@@ -3,21 +3,39 @@
 #include "Region.h"
 #include "CNVR.h"
 #include "Predicate.h"
+#include "get_regions.h"
+
+void query_model(
+    const Region &region,
+    const Predicate &pred1, const Predicate &pred2,
+    std::vector<CNVR> &result
+) {
+  if(pred1.match(region, 0) && pred2.match(region, 1)) {
+    result.emplace_back(region, Normal, 1);
+  }
+}
 
 void query_model(
     const std::vector<Region> &regions,
     int npatients1, int npatients2,
     COMPARISON comp1, double value1, EQUALITY eq1, VARIATION_TYPE type1,
     COMPARISON comp2, double value2, EQUALITY eq2, VARIATION_TYPE type2,
+    ThreadPool &pool,
     std::vector<CNVR> &result
 ) {
-  Predicate pred1 = make_predicate(comp1, value1, eq1, type1);
-  Predicate pred2 = make_predicate(comp2, value2, eq2, type2);
-  
-  for(size_t i = 0; i < regions.size(); ++i) {
-    const Region &r = regions[i];
-    if(pred1.match(r.state[0]) && pred2.match(r.state[1])) {
-      result.emplace_back(r, Normal, 1);
-    }
-  }
-}
\ No newline at end of file
+  Predicate pred1 = make_predicate(comp1, value1, eq1, type1, npatients1);
+  Predicate pred2 = make_predicate(comp2, value2, eq2, type2, npatients2);
+
+  evaluate_regions(regions, [&pred1, &pred2](const Region &r, std::vector<CNVR> &out) {
+    query_model(r, pred1, pred2, out);
+  }, pool, result);
+}
+
+void query_filter(
+    const Counts *counts, size_t n,
+    const Predicate &pred1, const Predicate &pred2,
+    unsigned char *keep
+) {
+  pred1.match(counts, n, 0, keep);
+  pred2.match(counts, n, 1, keep);
+}
@@ -5,13 +5,30 @@
 #include "defines.h"
 #include "Region.h"
 #include "CNVR.h"
+#include "Predicate.h"
+#include "ThreadPool.h"
 
+void query_model(
+    const Region &region,
+    const Predicate &pred1, const Predicate &pred2,
+    std::vector<CNVR> &result
+);
+
+// Evaluates the regions in chunks on the pool. Results are in region order.
 void query_model(
     const std::vector<Region> &regions,
     int npatients1, int npatients2,
     COMPARISON comp1, double value1, EQUALITY eq1, VARIATION_TYPE type1,
     COMPARISON comp2, double value2, EQUALITY eq2, VARIATION_TYPE type2,
+    ThreadPool &pool,
     std::vector<CNVR> &result
 );
 
-#endif
\ No newline at end of file
+// Clears keep[i] for each of the n regions not matching both predicates.
+void query_filter(
+    const Counts *counts, size_t n,
+    const Predicate &pred1, const Predicate &pred2,
+    unsigned char *keep
+);
+
+#endif
@@ -0,0 +1,133 @@
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include "qvalues.h"
+
+unsigned int compute_qvalues(
+  const std::vector<int> &initial_groups,
+  const PermutedResults &permuted,
+  unsigned int rep,
+  unsigned int stop,
+  double threshold,
+  ThreadPool &pool,
+  Progress &progress,
+  Profile *profile,
+  NullDistribution &null,
+  std::vector<CNVR> &results
+) {
+  const size_t lanes = PermutationEngine::BATCH_SIZE;
+
+  // per-worker buffers, reused across repetitions
+  std::vector<std::minstd_rand> rands;
+  std::vector<std::vector<std::vector<int>>> groups(pool.size(), std::vector<std::vector<int>>(lanes, initial_groups));
+  std::vector<std::vector<std::vector<CNVR>>> q_results(pool.size());
+  std::random_device rd;
+  for(size_t tid = 0; tid < pool.size(); ++tid) {
+    rands.emplace_back(rd());
+  }
+  if(profile) {
+    profile->worker_permutations.assign(pool.size(), 0);
+    profile->worker_seconds.assign(pool.size(), 0);
+  }
+
+  // With adaptive stopping, repetitions run in rounds and stop once every
+  // result has seen stop permuted maxima at least as long as itself
+  // (Besag and Clifford, 1991) or can no longer reach threshold. Rounds
+  // give every worker a full batch.
+  bool adaptive = stop > 0 || threshold >= 0;
+  unsigned int round = adaptive ? std::max<size_t>(100, lanes * pool.size()) : rep;
+  auto done = [&]() {
+    if(null.size() >= rep) return true;
+    if(!adaptive || null.size() == 0) return false;
+    for(const CNVR &c : results) {
+      size_t better = null.count(c.query, c.type, c.length);
+      bool converged = stop > 0 && better >= stop;
+      bool rejected = threshold >= 0 && better > threshold * rep;
+      if(!converged && !rejected) return false;
+    }
+    return true;
+  };
+
+  // longest permuted result of each query and type in each repetition
+  std::vector<std::vector<int>> best(4*null.queries());
+
+  progress.begin(rep - std::min<size_t>(rep, null.size()));
+  while(!done()) {
+    unsigned int n = std::min<size_t>(round, rep - null.size());
+    for(std::vector<int> &b : best) b.assign(n, 0);
+
+    pool.parallel_for((n + lanes - 1) / lanes, [&](size_t batch) {
+      size_t tid = pool.worker_id();
+      std::chrono::steady_clock::time_point began = std::chrono::steady_clock::now();
+      size_t first = batch * lanes;
+      size_t m = std::min<size_t>(lanes, n - first);
+
+      for(size_t r = 0; r < m; ++r) {
+        std::shuffle(groups[tid][r].begin(), groups[tid][r].end(), rands[tid]);
+      }
+      permuted(groups[tid], m, q_results[tid]);
+
+      for(size_t r = 0; r < m; ++r) {
+        for(const CNVR &c : q_results[tid][r]) {
+          std::vector<int> &b = best[4*c.query + c.type];
+          b[first + r] = std::max(b[first + r], c.length);
+        }
+      }
+      progress.advance(m);
+
+      // each worker only updates its own entries
+      if(profile) {
+        profile->worker_permutations[tid] += m;
+        profile->worker_seconds[tid] += std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+      }
+    });
+    if(pool.cancelled()) return 0;
+
+    null.add(best);
+  }
+  progress.end();
+
+  for(CNVR &c : results) {
+    c.qvalue = (double)null.count(c.query, c.type, c.length) / null.size();
+  }
+
+  std::stable_sort(results.begin(), results.end(), [](const CNVR &a, const CNVR &b) {
+    if(a.query != b.query) return a.query < b.query;
+    return a.qvalue < b.qvalue;
+  });
+
+  return null.size();
+}
+
+unsigned int compute_qvalues(
+  const PermutationEngine &engine,
+  const RegionModel &model,
+  const HitBounds *bounds,
+  bool merge,
+  unsigned int merge_threshold,
+  unsigned int rep,
+  unsigned int stop,
+  double threshold,
+  ThreadPool &pool,
+  Progress &progress,
+  Profile *profile,
+  NullDistribution &null,
+  std::vector<CNVR> &results
+) {
+  // group of each patient, group 1 patients first
+  std::vector<int> groups(engine.patients(), 1);
+  std::fill(groups.begin(), groups.begin()+engine.patients(0), 0);
+
+  PermutedResults permuted = [&](const std::vector<std::vector<int>> &g, size_t n, std::vector<std::vector<CNVR>> &r) {
+    // bit r of each patient's mask is set if it is in group 1 in permutation r
+    std::vector<uint64_t> masks(engine.patients(), 0);
+    for(size_t k = 0; k < n; ++k) {
+      for(size_t i = 0; i < masks.size(); ++i) {
+        if(g[k][i] == 0) masks[i] |= (uint64_t)1 << k;
+      }
+    }
+    engine.get_batch_results(masks, n, model, bounds, merge, merge_threshold, r);
+  };
+  return compute_qvalues(groups, permuted, rep, stop, threshold, pool, progress, profile, null, results);
+}
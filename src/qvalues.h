@@ -0,0 +1,64 @@
+#ifndef QVALUES_H
+#define QVALUES_H
+
+#include <vector>
+#include <functional>
+#include "CNVR.h"
+#include "PermutationEngine.h"
+#include "NullDistribution.h"
+#include "get_regions.h"
+#include "ThreadPool.h"
+#include "Progress.h"
+#include "Profile.h"
+
+// Results of a model on a batch of permuted group labels. groups[r] holds
+// the group of each global patient in permutation r, of which the first n
+// are evaluated into results[r]. Results must not reference any regions.
+typedef std::function<void(
+  const std::vector<std::vector<int>>&, size_t, std::vector<std::vector<CNVR>>&
+)> PermutedResults;
+
+// Computes q-values of the results by repeatedly evaluating the model on
+// permuted group labels, then sorts results by query and q-value. Results
+// of each query are compared to the permuted results of the same query,
+// all sharing one set of permutations. If bounds is set, the model is
+// only evaluated on permuted counts within them.
+//
+// Permutations are added to null until it holds rep repetitions. With
+// stop > 0 or threshold >= 0, repetitions run in rounds and stop early
+// (see convaq()). Each task evaluates up to PermutationEngine::BATCH_SIZE
+// repetitions in a single pass. Completed repetitions are reported to
+// progress, and the repetitions and busy time of each worker to profile
+// unless it is null.
+// Returns the number of repetitions used, or 0 if cancelled.
+unsigned int compute_qvalues(
+  const PermutationEngine &engine,
+  const RegionModel &model,
+  const HitBounds *bounds,
+  bool merge,
+  unsigned int merge_threshold,
+  unsigned int rep,
+  unsigned int stop,
+  double threshold,
+  ThreadPool &pool,
+  Progress &progress,
+  Profile *profile,
+  NullDistribution &null,
+  std::vector<CNVR> &results
+);
+
+// As above, with permutations of the initial groups evaluated by permuted.
+unsigned int compute_qvalues(
+  const std::vector<int> &groups,
+  const PermutedResults &permuted,
+  unsigned int rep,
+  unsigned int stop,
+  double threshold,
+  ThreadPool &pool,
+  Progress &progress,
+  Profile *profile,
+  NullDistribution &null,
+  std::vector<CNVR> &results
+);
+
+#endif
@@ -0,0 +1,47 @@
+#include <Rcpp.h>
+#include <string>
+#include <thread>
+#include "MappedFile.h"
+#include "SegmentParser.h"
+#include "ThreadPool.h"
+#include "check_interrupt.h"
+
+using namespace Rcpp;
+
+static IntegerVector as_factor(IntegerVector codes, const std::vector<std::string> &levels) {
+  codes.attr("levels") = CharacterVector(levels.begin(), levels.end());
+  codes.attr("class") = "factor";
+  return codes;
+}
+
+// [[Rcpp::export]]
+DataFrame readSegmentsCpp(std::string path, bool header, unsigned int nthreads) {
+  if(nthreads == 0) nthreads = std::thread::hardware_concurrency();
+
+  ThreadPool pool(nthreads);
+  pool.set_interrupt_check(check_interrupt);
+
+  MappedFile file(path);
+  SegmentParser parser(file.data(), file.size(), header, pool);
+  if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
+
+  // parse straight into the output columns
+  size_t n = parser.rows();
+  IntegerVector patient(no_init(n));
+  IntegerVector chr(no_init(n));
+  IntegerVector start(no_init(n));
+  IntegerVector end(no_init(n));
+  IntegerVector type(no_init(n));
+  parser.parse(INTEGER(patient), INTEGER(chr), INTEGER(start), INTEGER(end), INTEGER(type), 1);
+  if(pool.cancelled()) throw Rcpp::internal::InterruptedException();
+
+  std::vector<std::string> types = {"gain", "loss", "loh"};
+
+  return DataFrame::create(
+    Named("patient") = as_factor(patient, parser.patients()),
+    Named("chr") = as_factor(chr, parser.chromosomes()),
+    Named("start") = start,
+    Named("end") = end,
+    Named("type") = as_factor(type, types)
+  );
+}
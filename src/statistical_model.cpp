@@ -1,22 +1,57 @@
 #include <vector>
-#include <numeric>
+#include <algorithm>
 #include "Region.h"
 #include "CNVR.h"
 #include "fisher_test.h"
+#include "statistical_model.h"
+#include "get_regions.h"
 
-void statistical_model(const std::vector<Region> &regions, int npatients1, int npatients2, double cutoff, std::vector<CNVR> &result) {
-  for(size_t i = 0; i < regions.size(); ++i) {
-    const Region &r = regions[i];
-    for(size_t type = 0; type < 3; ++type) {
-      int pos1 = std::accumulate(r.state[0][type].begin(), r.state[0][type].end(), 0);
-      int neg1 = npatients1 - pos1;
-      int pos2 = std::accumulate(r.state[1][type].begin(), r.state[1][type].end(), 0);
-      int neg2 = npatients2 - pos2;
-
-      double pval = fisher_test(pos1, neg1, pos2, neg2);
-      if(pval <= cutoff) {
-        result.emplace_back(r, type, pval);
+void statistical_model(const Region &region, const FisherTable &fisher, double cutoff, std::vector<CNVR> &result) {
+  for(size_t type = 0; type < 3; ++type) {
+    double pval = fisher(region.count(0, type), region.count(1, type));
+    if(pval <= cutoff) {
+      result.emplace_back(region, type, pval);
+    }
+  }
+}
+
+void statistical_model(const std::vector<Region> &regions, const FisherTable &fisher, double cutoff, ThreadPool &pool, std::vector<CNVR> &result) {
+  evaluate_regions(regions, [&fisher, cutoff](const Region &r, std::vector<CNVR> &out) {
+    statistical_model(r, fisher, cutoff, out);
+  }, pool, result);
+}
+
+HitBounds statistical_bounds(const FisherTable &fisher, double cutoff) {
+  int npatients1 = fisher.patients(0);
+  int npatients2 = fisher.patients(1);
+  HitBounds bounds(npatients1, npatients2);
+
+  for(int total = 0; total <= npatients1 + npatients2; ++total) {
+    int first = std::max(0, total - npatients2);
+    int last = std::min(npatients1, total);
+    auto hit = [&](int pos1) { return fisher(pos1, total - pos1) <= cutoff; };
+
+    // no count of the margin can pass the cutoff
+    if(fisher.min_pvalue(total) > cutoff) {
+      for(size_t type = 0; type < 3; ++type) bounds.set(type, total, first - 1, last + 1);
+      continue;
+    }
+
+    int low = first - 1;
+    while(low < last && hit(low + 1)) ++low;
+    int high = last + 1;
+    while(high - 1 > low && hit(high - 1)) --high;
+
+    // keep every count if a result lies between the tails, e.g. due to
+    // rounding of nearly equal pdfs
+    for(int pos1 = low + 1; pos1 < high; ++pos1) {
+      if(hit(pos1)) {
+        low = last;
+        break;
       }
     }
+
+    for(size_t type = 0; type < 3; ++type) bounds.set(type, total, low, high);
   }
+  return bounds;
 }
@@ -4,7 +4,18 @@
 #include <vector>
 #include "CNVR.h"
 #include "Region.h"
+#include "fisher_test.h"
+#include "HitBounds.h"
+#include "ThreadPool.h"
 
-void statistical_model(const std::vector<Region> &regions, int npatients1, int npatients2, double cutoff, std::vector<CNVR> &result);
+void statistical_model(const Region &region, const FisherTable &fisher, double cutoff, std::vector<CNVR> &result);
+
+// Evaluates the regions in chunks on the pool. Results are in region order.
+void statistical_model(const std::vector<Region> &regions, const FisherTable &fisher, double cutoff, ThreadPool &pool, std::vector<CNVR> &result);
+
+// Counts for which the statistical model with the given cutoff reports a
+// result. p-values only decrease away from the most likely count of each
+// margin, so results lie in the two tails of the margin.
+HitBounds statistical_bounds(const FisherTable &fisher, double cutoff);
 
 #endif